@@ -1,12 +1,149 @@
 #include "application.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <boost/regex.hpp>
+#include <cerrno>
+#include <chrono>
 #include <regex>
+#include <sys/stat.h>
+#include <thread>
+#include <tuple>
 
 #include "error_logger.hpp"
+#include "json_writer.hpp"
 #include "net_manager.hpp"
 #include "thread_manager.hpp"
 
+namespace {
+	/**
+	 * @brief 处理已有文件时的一个文件
+	 */
+	struct BackfillTask {
+		const work::data::DataSourcePathDetail* path_detail;
+		const std::string*											dir_name;
+		std::string															file;
+		// 完整的时间串，用于排序
+		std::string															time;
+		uint64_t																size;
+	};
+
+	/**
+	 * @brief 处理已有文件时的一个源，同一个源中的数据按照时间顺序发送
+	 */
+	struct BackfillSource {
+		const std::string*																				 name = nullptr;
+		const work::data::SourcePlan*															 plan = nullptr;
+		// 已经按照时间排序
+		std::vector<BackfillTask>																	 tasks;
+		// 保护下面的数据，std::mutex不能移动，所以放在堆上
+		std::unique_ptr<std::mutex>																 mutex{new std::mutex};
+		// 解析的结果，发送之后清空
+		std::vector<std::pair<std::string, work::data::FileDataType>> results;
+		std::vector<bool>																					 done;
+		// 下一个要发送的文件
+		size_t																										 posted = 0;
+	};
+
+	uint64_t DoGetFileSize(const std::string& filename) {
+		struct stat st {};
+		if (::stat(filename.c_str(), &st) != 0) {
+			return 0;
+		}
+		return static_cast<uint64_t>(st.st_size);
+	}
+
+	/**
+	 * @brief 记录的数量达到prune_at时移除文件已经不存在的记录(例如整个目录被移走时不会收到每个文件的事件)，
+	 * 之后在数量翻倍时再检查，平摊到每次插入是常数时间
+	 * @param records 文件的绝对路径 <-> 记录
+	 * @param prune_at 下一次检查时的数量
+	 * @param removable 记录是否可以移除(例如没有在使用)
+	 */
+	template<typename Map, typename Pred>
+	void DoPruneMissingFiles(Map& records, std::size_t& prune_at, Pred removable) {
+		if (records.size() < prune_at) {
+			return;
+		}
+		for (auto it = records.begin(); it != records.end();) {
+			struct stat st {};
+			if (removable(it->second) && ::stat(it->first.c_str(), &st) != 0 && errno == ENOENT) {
+				it = records.erase(it);
+			} else {
+				++it;
+			}
+		}
+		prune_at = std::max<std::size_t>(records.size() * 2, 1024);
+	}
+
+	/**
+	 * @brief 检查同一个json对象中的键替换之后是否重复
+	 * @param field_replace 替换表
+	 * @param keys 同一个对象中的所有键
+	 * @param collision 重复时写入重复的键
+	 * @return 是否重复
+	 */
+	bool DoFindRenameCollision(const std::map<std::string, std::string>& field_replace, const std::vector<std::string>& keys, std::string& collision) {
+		// 替换后的键 <-> 原来的键
+		std::unordered_map<std::string, const std::string*> renamed;
+		for (const auto& key: keys) {
+			auto				it	 = field_replace.find(key);
+			const auto& name = it == field_replace.end() ? key : it->second;
+			auto				ret	 = renamed.emplace(name, &key);
+			if (!ret.second && *ret.first->second != key) {
+				collision = *ret.first->second + ", " + key + " -> " + name;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * @brief 检查替换表是否会让某个源的数据输出重复的键(类型名之间，以及固定字段与填充的字段之间)
+	 * @param field_replace 替换表
+	 * @param sources 所有的源
+	 * @param collision 重复时写入重复的键
+	 * @return 是否重复
+	 */
+	bool DoFindReplaceCollision(const std::map<std::string, std::string>& field_replace, const work::data::SourceMapping& sources, std::string& collision) {
+		if (field_replace.empty()) {
+			return false;
+		}
+		for (const auto& name_source: sources) {
+			const auto&							 detail = name_source.second.detail;
+			std::vector<std::string> types;
+			for (const auto& field: detail.field) {
+				types.push_back(field.first);
+			}
+			if (DoFindRenameCollision(field_replace, types, collision)) {
+				return true;
+			}
+
+			std::vector<std::string> fields{work::data::wins_name, work::data::imps_name, work::data::clks_name, work::data::cost_name};
+			if (!detail.pad_data.empty() && !detail.pad_field_name.empty()) {
+				// 与填充时相同，值为null的键会被去掉，无法解析的填充数据不会填充
+				auto pad = nlohmann::json::parse(detail.pad_data, nullptr, false);
+				if (pad.is_object()) {
+					for (const auto& item: pad.items()) {
+						if (!item.value().is_null() && std::find(fields.cbegin(), fields.cend(), item.key()) == fields.cend()) {
+							fields.push_back(item.key());
+						}
+					}
+				}
+			}
+			if (DoFindRenameCollision(field_replace, fields, collision)) {
+				collision = name_source.first + ": " + collision;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::string DoFormatMegabytes(uint64_t bytes) {
+		return std::to_string(bytes / (1 << 20));
+	}
+}// namespace
+
 namespace work {
 	Application::Application(std::string config_path)
 		: config_path_(std::move(config_path)) {
@@ -15,29 +152,95 @@ namespace work {
 	bool Application::Init() {
 		// 载入配置文件
 		config_manager_ = FileManager::LoadConfig(config_path_);
+		// 日志的选项
+		const auto& setting = config_manager_.setting;
+		if (setting.log_overflow != "block" && setting.log_overflow != "drop") {
+			LOG2FILE(LOG_LEVEL::WARNING, "Unknown log_overflow " + setting.log_overflow + ", use block");
+		}
+		if (setting.log_format != "text" && setting.log_format != "binary") {
+			LOG2FILE(LOG_LEVEL::WARNING, "Unknown log_format " + setting.log_format + ", use text");
+		}
+		LogOption log_option;
+		if (setting.log_level == "warning") {
+			log_option.level = LOG_LEVEL::WARNING;
+		} else if (setting.log_level == "error") {
+			log_option.level = LOG_LEVEL::ERROR;
+		} else if (setting.log_level != "info") {
+			LOG2FILE(LOG_LEVEL::WARNING, "Unknown log_level " + setting.log_level + ", use info");
+		}
+		log_option.flush_interval = setting.log_flush_interval;
+		log_option.buffer_size		= setting.log_buffer_size;
+		log_option.overflow				= setting.log_overflow == "drop" ? LOG_OVERFLOW::DROP : LOG_OVERFLOW::BLOCK;
+		log_option.format					= setting.log_format == "binary" ? LOG_FORMAT::BINARY : LOG_FORMAT::TEXT;
+		for (const auto& limit: setting.log_rate_limit) {
+			if (limit.first == "info") {
+				log_option.rate_limit[static_cast<int>(LOG_LEVEL::INFO)] = limit.second;
+			} else if (limit.first == "warning") {
+				log_option.rate_limit[static_cast<int>(LOG_LEVEL::WARNING)] = limit.second;
+			} else if (limit.first == "error") {
+				log_option.rate_limit[static_cast<int>(LOG_LEVEL::ERROR)] = limit.second;
+			} else {
+				LOG2FILE(LOG_LEVEL::WARNING, "Unknown log level " + limit.first + " in log_rate_limit, ignored");
+			}
+		}
+		SetLogOption(log_option);
+		// 替换之后重复的键会输出重复的json键，忽略这样的目标
+		for (auto it = config_manager_.target.begin(); it != config_manager_.target.end();) {
+			std::string collision;
+			if (DoFindReplaceCollision(it->second.field_replace, config_manager_.source, collision)) {
+				LOG2FILE(LOG_LEVEL::ERROR, "field_replace of target " + it->first + " makes duplicate keys, target ignored: " + collision);
+				it = config_manager_.target.erase(it);
+			} else {
+				++it;
+			}
+		}
 		// 初始化watchdog
 		if (!InitWatchdog()) {
 			return false;
 		}
 
+		// 创建流水线，watchdog的回调会将事件放入流水线
+		InitPipeline();
 		// 唤醒watchdog
+		watchdog_.SetQuietWindow(std::chrono::milliseconds(config_manager_.setting.coalesce_window));
+		watchdog_.SetPollInterval(std::chrono::milliseconds(config_manager_.setting.poll_min_interval), std::chrono::milliseconds(config_manager_.setting.poll_max_interval));
 		WakeUpWatchdog();
 		return true;
 	}
 
+	Application::~Application() = default;
+
 	void Application::Run() {
-		ThreadManager thread;
+		const auto& setting					= config_manager_.setting;
+		auto				dispatch_worker = std::max(setting.dispatch_worker, static_cast<size_t>(1));
+		auto				backfill_thread = setting.backfill_thread;
+		if (backfill_thread == 0) {
+			backfill_thread = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		// 所有的工作都在同一个线程池中完成，线程数在启动时确定，不随文件的速率变化
+		// 处理已有文件的线程在处理完之后用于并行解析大文件以及重新扫描目录
+		auto thread_count = GetPipelineThreadCount() + 1 + dispatch_worker + backfill_thread;
+		thread_.reset(new ThreadManager(thread_count));
+		LOG2FILE(LOG_LEVEL::INFO, "Thread pool started: " + std::to_string(thread_count) + " threads");
+
+		std::vector<std::future<void>> loops;
+		// 流水线中每个阶段的线程
+		StartPipeline(loops);
 		// 处理已有文件的线程
-		thread.PushFunction(&Application::ProcessAllExistFile, this);
+		thread_->PushFunction(&Application::ProcessAllExistFile, this);
 
-		// 遍历源
-		for (const auto& name_source: config_manager_.source) {
-			// 遍历源所在的路径
-			for (const auto& dir_path_detail: name_source.second.path) {
-				// todo: 当前处理方式为对于每个文件夹都提供一个线程监控，但其实监控占用的资源很少，可以让一个线程监控多个文件夹
-				thread.PushFunction(&DirWatchdog::Run, &watchdog_, dir_path_detail.first);
-			}
+		// 一个线程监控所有的文件夹，回调函数在分发线程中执行
+		loops.push_back(thread_->Submit(&DirWatchdog::Run, &watchdog_));
+		for (size_t i = 0; i < dispatch_worker; ++i) {
+			loops.push_back(thread_->Submit(&DirWatchdog::Dispatch, &watchdog_));
+		}
+
+		// 等待所有的阶段结束(watchdog停止之后)，之后等待线程池中剩下的任务完成
+		for (auto& loop: loops) {
+			thread_->Wait(loop);
 		}
+		thread_->Shutdown();
 	}
 
 	bool Application::InitWatchdog() {
@@ -48,8 +251,14 @@ namespace work {
 
 		for (const auto& name_source: config_manager_.source) {
 			for (const auto& dir_path_detail: name_source.second.path) {
+				const auto& backend_name = dir_path_detail.second.watch_backend;
+				if (backend_name != "inotify" && backend_name != "poll") {
+					LOG2FILE(LOG_LEVEL::ERROR, "Unknown watch_backend " + backend_name + " of " + dir_path_detail.first);
+					return false;
+				}
+				auto backend = backend_name == "poll" ? DirWatchdog::BACKEND::POLL : DirWatchdog::BACKEND::INOTIFY;
 				// 将源中的文件夹全部添加到watchdog的监控路径
-				if (!watchdog_.AddPath(dir_path_detail.first)) {
+				if (!watchdog_.AddPath(dir_path_detail.first, dir_path_detail.second.recursive, backend)) {
 					return false;
 				}
 			}
@@ -58,7 +267,14 @@ namespace work {
 	}
 
 	void Application::ProcessAllExistFile() {
-		// 处理已有的文件
+		std::vector<BackfillSource> sources;
+		sources.reserve(config_manager_.source.size());
+		// 所有文件，(源的下标, 文件在源中的下标)
+		std::vector<std::pair<size_t, size_t>> order;
+
+		// 先一起搜索所有路径(文件夹)中符合条件的文件
+		std::vector<FileManager::ScanRequest>						 requests;
+		std::vector<const data::DataSourcePathDetail*> request_detail;
 		for (const auto& name_source: config_manager_.source) {
 			for (const auto& dir_path_detail: name_source.second.path) {
 				// 对于时间不合法的路径直接跳过
@@ -66,52 +282,203 @@ namespace work {
 					continue;
 				}
 
-				// 获取目标路径(文件夹)中的所有符合条件的文件名
-				auto files = FileManager::GetFilesInPath(
+				const auto* path_detail = &dir_path_detail.second;
+				requests.push_back({
 						// 路径(文件夹)
 						dir_path_detail.first,
 						// 是否递归
-						dir_path_detail.second.recursive,
+						path_detail->recursive,
 						// 辅助判断条件
-						[&dir_path_detail](const std::string& filename) -> bool {
+						[path_detail](const std::string& filename) -> bool {
 							// 文件名应该合法
-							return dir_path_detail.second.IsFileValid(filename);
-						});
+							return path_detail->IsFileValid(filename);
+						}});
+				request_detail.push_back(path_detail);
+			}
+		}
 
-				if (files.empty()) {
+		const auto scan_begin = std::chrono::steady_clock::now();
+		auto			 scanned		= FileManager::GetFilesInPaths(requests, thread_.get());
+		size_t		 file_count = 0;
+		for (size_t i = 0; i < requests.size(); ++i) {
+			LOG2FILE(LOG_LEVEL::INFO, "Found " + std::to_string(scanned[i].size()) + " files in " + requests[i].path);
+			file_count += scanned[i].size();
+		}
+		LOG2FILE(LOG_LEVEL::INFO, "Scanned " + std::to_string(requests.size()) + " paths, " + std::to_string(file_count) + " files, " + std::to_string(std::chrono::duration<double>(std::chrono::steady_clock::now() - scan_begin).count()) + " s");
+
+		// 处理已有的文件，搜索结果与请求的顺序一致
+		size_t request_index = 0;
+		for (const auto& name_source: config_manager_.source) {
+			BackfillSource source;
+			source.name = &name_source.first;
+			source.plan = name_source.second.plan.get();
+
+			for (const auto& dir_path_detail: name_source.second.path) {
+				if (request_index == requests.size() || request_detail[request_index] != &dir_path_detail.second) {
 					continue;
 				}
+				auto& files = scanned[request_index++];
+
+				for (auto& file: files) {
+					auto target_time = dir_path_detail.second.start_time.GetTargetFullTime(dir_path_detail.second.GetFileTimeStr(FileManager::GetFilenameInPath(file)), dir_path_detail.first);
+					if (!target_time.first) {
+						LOG2FILE(LOG_LEVEL::WARNING, "Already processed file: " + file);
+						continue;
+					}
+					auto size = DoGetFileSize(file);
+					DoMarkProcessed(file, size);
+					source.tasks.push_back({&dir_path_detail.second, &dir_path_detail.first, std::move(file), std::move(target_time.second), size});
+				}
+			}
+
+			if (source.tasks.empty()) {
+				continue;
+			}
+
+			// 同一个源中的数据按照时间顺序发送
+			std::sort(source.tasks.begin(), source.tasks.end(), [](const BackfillTask& lhs, const BackfillTask& rhs) {
+				return std::tie(lhs.time, lhs.file) < std::tie(rhs.time, rhs.file);
+			});
+			source.results.resize(source.tasks.size());
+			source.done.assign(source.tasks.size(), false);
+
+			for (size_t i = 0; i < source.tasks.size(); ++i) {
+				order.emplace_back(sources.size(), i);
+			}
+			sources.push_back(std::move(source));
+		}
+
+		if (order.empty()) {
+			return;
+		}
+
+		// 所有源一起按照时间顺序分配，较早的文件先解析
+		std::stable_sort(order.begin(), order.end(), [&sources](const std::pair<size_t, size_t>& lhs, const std::pair<size_t, size_t>& rhs) {
+			return sources[lhs.first].tasks[lhs.second].time < sources[rhs.first].tasks[rhs.second].time;
+		});
+
+		uint64_t total_bytes = 0;
+		for (const auto& source: sources) {
+			for (const auto& task: source.tasks) {
+				total_bytes += task.size;
+			}
+		}
+
+		auto thread_count = config_manager_.setting.backfill_thread;
+		if (thread_count == 0) {
+			thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+		thread_count = std::min(thread_count, order.size());
+
+		LOG2FILE(LOG_LEVEL::INFO, "Backfill started: " + std::to_string(order.size()) + " files, " + DoFormatMegabytes(total_bytes) + " MB, " + std::to_string(thread_count) + " threads");
+
+		using clock = std::chrono::steady_clock;
+		const auto					 begin_time = clock::now();
+		const auto					 interval		= std::chrono::seconds(config_manager_.setting.backfill_report_interval);
+		std::atomic<size_t>	 next{0};
+		std::atomic<size_t>	 done_files{0};
+		std::atomic<uint64_t> done_bytes{0};
+		std::mutex					 report_mutex;
+		auto								 last_report = begin_time;
+
+		auto report = [&](const std::string& title) {
+			auto elapsed = std::chrono::duration<double>(clock::now() - begin_time).count();
+			auto files	 = done_files.load();
+			auto bytes	 = done_bytes.load();
+			auto seconds = std::max(elapsed, 1e-6);
+			LOG2FILE(LOG_LEVEL::INFO,
+							 title + ": " + std::to_string(files) + "/" + std::to_string(order.size()) + " files, " +
+									 DoFormatMegabytes(bytes) + "/" + DoFormatMegabytes(total_bytes) + " MB, " +
+									 std::to_string(elapsed) + " s, " +
+									 std::to_string(static_cast<double>(files) / seconds) + " files/s, " +
+									 std::to_string(static_cast<double>(bytes) / seconds / (1 << 20)) + " MB/s");
+		};
+
+		auto worker = [&]() {
+			for (;;) {
+				auto index = next.fetch_add(1);
+				if (index >= order.size()) {
+					return;
+				}
+
+				auto&				source = sources[order[index].first];
+				auto				i			 = order[index].second;
+				const auto& task	 = source.tasks[i];
+
+				auto time_data		 = DoResolveData(*task.path_detail, task.file, *task.dir_name, *source.plan);
+
+				{
+					// 按照顺序将已经解析完成的连续的部分交给聚合阶段，较晚的文件先解析完时等待较早的文件
+					std::lock_guard<std::mutex> lock(*source.mutex);
+					source.results[i] = std::move(time_data);
+					source.done[i]		= true;
+					while (source.posted < source.done.size() && source.done[source.posted]) {
+						SubmitParsedData(*source_state_.at(*source.name), std::move(source.results[source.posted]));
+						// 已经交出的数据不再需要
+						source.results[source.posted] = {};
+						++source.posted;
+					}
+				}
+
+				done_files.fetch_add(1);
+				done_bytes.fetch_add(task.size);
 
-				// 解析并发送所有读取到的文件
-				for (const auto& file: files) {
-					DoResolveAndPostData(
-							dir_path_detail.second,
-							file,
-							dir_path_detail.first,
-							name_source.second.detail);
+				if (interval.count() > 0) {
+					std::unique_lock<std::mutex> lock(report_mutex, std::try_to_lock);
+					if (lock.owns_lock() && clock::now() - last_report >= interval) {
+						last_report = clock::now();
+						report("Backfill progress");
+					}
 				}
 			}
+		};
+
+		ThreadManager::TaskGroup			 group{*thread_};
+		std::vector<std::future<void>> futures;
+		for (size_t i = 1; i < thread_count; ++i) {
+			futures.push_back(group.Submit(worker));
+		}
+		// 当前线程也参与处理
+		worker();
+		for (auto& future: futures) {
+			group.Wait(future);
 		}
+
+		report("Backfill finished");
 	}
 
 	void Application::WakeUpWatchdog() {
 		for (const auto& name_source: config_manager_.source) {
+			auto* source = source_state_.at(name_source.first).get();
 			for (const auto& dir_path_detail: name_source.second.path) {
-				// hook 文件关闭应该能够满足需求
-				if (!watchdog_.SetWatch(dir_path_detail.first, DirWatchdog::IN_MOVED_TO)) {
+				// hook 文件关闭应该能够满足需求，追加模式还需要在文件被写入时解析新追加的部分
+				auto event = dir_path_detail.second.tail ? static_cast<DirWatchdog::EVENT_TYPE>(DirWatchdog::IN_MOVED_TO | DirWatchdog::IN_MODIFY | DirWatchdog::IN_CLOSE_WRITE) : DirWatchdog::IN_MOVED_TO;
+				// 文件被删除或者移走时移除它的记录
+				event			 = static_cast<DirWatchdog::EVENT_TYPE>(event | DirWatchdog::IN_DELETE | DirWatchdog::IN_MOVED_FROM);
+				if (!watchdog_.SetWatch(dir_path_detail.first, event)) {
 					LOG2FILE(LOG_LEVEL::ERROR, "Cannot set watch to " + dir_path_detail.first);
 				}
 				if (!watchdog_.SetCallback(
 								dir_path_detail.first,
-								[&](uint32_t event_code, const std::string& filename) {
-									if (!dir_path_detail.second.IsFileValid(filename)) {
+								[&, source](uint32_t event_code, const std::string& filename) {
+									if (event_code & DirWatchdog::IN_Q_OVERFLOW) {
+										// 有事件丢失
+										DoRescan(*source, *name_source.second.plan, dir_path_detail.first, dir_path_detail.second);
 										return;
 									}
-									DoResolveAndPostData(
-											dir_path_detail.second,
-											filename,
-											dir_path_detail.first,
-											name_source.second.detail);
+									// 递归监控时文件名是相对路径，只校验最后的文件名
+									if (!dir_path_detail.second.IsFileValid(filename.find('/') == std::string::npos ? filename : FileManager::GetFilenameInPath(filename))) {
+										return;
+									}
+									if (event_code & (DirWatchdog::IN_DELETE | DirWatchdog::IN_MOVED_FROM)) {
+										DoForgetFile(FileManager::GetAbsolutePath(filename, dir_path_detail.first));
+										// 合并的事件中还有写入或者移入时依然需要接收
+										if ((event_code & ~(DirWatchdog::IN_DELETE | DirWatchdog::IN_MOVED_FROM)) == 0) {
+											return;
+										}
+									}
+									// 扫描新目录发现的文件可能已经通过事件接收过
+									DoIntake(*source, *name_source.second.plan, dir_path_detail.first, dir_path_detail.second, filename, event_code & DirWatchdog::IN_SCANNED);
 								})) {
 					LOG2FILE(LOG_LEVEL::ERROR, "Cannot set callback to " + dir_path_detail.first);
 				}
@@ -123,9 +490,9 @@ namespace work {
 			const data::DataSourcePathDetail&	 path_detail,
 			const std::string&								 filename,
 			const std::string&								 dir_name,
-			const data::DataSourceFieldDetail& field_detail) {
+			const data::SourcePlan&					 plan) const {
 		// 获取目标文件的包含时间的字符子串，保证是合法的时间串
-		auto time_str		 = path_detail.GetFileTimeStr(filename);
+		auto time_str		 = path_detail.GetFileTimeStr(FileManager::GetFilenameInPath(filename));
 
 		// 将文件名的时间子串与路径中的时间子串组合起来
 		auto target_time = path_detail.start_time.GetTargetFullTime(time_str, dir_name);
@@ -134,70 +501,311 @@ namespace work {
 			return {};
 		}
 
+		auto full_path = FileManager::GetAbsolutePath(filename, dir_name);
+
+		if (path_detail.tail) {
+			// 只载入新追加的部分
+			auto message = DoResolveAppendedData(plan, data::GetFileType(path_detail.type), full_path);
+			if (std::all_of(message.cbegin(), message.cend(), [](const data::DataWithType& d) { return d.data.empty(); })) {
+				// 没有新追加的完整的行
+				return {};
+			}
+			return std::make_pair(target_time.second, message);
+		}
+
 		// 载入目标文件的数据
 		auto message = FileManager::LoadFile(
-				field_detail,
+				plan,
 				data::GetFileType(path_detail.type),
-				FileManager::GetAbsolutePath(filename, dir_name));
+				full_path,
+				'\t',
+				thread_.get());
 
 		if (message.empty()) {
-			LOG2FILE(LOG_LEVEL::ERROR, "Cannot load anything from " + FileManager::GetAbsolutePath(filename, dir_name));
+			LOG2FILE(LOG_LEVEL::ERROR, "Cannot load anything from " + full_path);
 			return {};
 		}
 
 		return std::make_pair(target_time.second, message);
 	}
 
-	void Application::DoPostData(const std::string& time, const data::FileDataType& data, const data::TargetMapping& target) {
-		// 时间或者数据为空都直接跳过
-		if (time.empty() || data.empty()) {
-			LOG2FILE(LOG_LEVEL::ERROR, "Timestamp or data is empty, cannot post");
-			return;
+	data::FileDataType Application::DoResolveAppendedData(
+			const data::SourcePlan&					 plan,
+			data::FILE_TYPE										 type,
+			const std::string&								 full_path) const {
+		std::shared_ptr<TailState> state;
+		{
+			std::lock_guard<std::mutex> lock(tail_mutex_);
+			// 正在被其他线程解析的状态不能移除
+			DoPruneMissingFiles(tail_state_, tail_prune_at_, [](const std::shared_ptr<TailState>& state) { return state.use_count() == 1; });
+			auto& it = tail_state_[full_path];
+			if (!it) {
+				it = std::make_shared<TailState>();
+			}
+			state = it;
 		}
 
-		nlohmann::json json;
-		json[time] = data;
+		// 同一个文件的增量必须按顺序解析
+		std::lock_guard<std::mutex> lock(state->mutex);
+		return FileManager::LoadAppendedFile(plan, type, full_path, state->position, '\t', thread_.get());
+	}
+
+	void Application::InitPipeline() {
+		const auto& setting = config_manager_.setting;
 
-		nlohmann::json json_sum;
-		json_sum[time]					 = data::GetSumOfFileDataType(data);
+		for (const auto& name_source: config_manager_.source) {
+			source_state_.emplace(name_source.first, std::unique_ptr<SourceState>{new SourceState});
+		}
 
-		std::string json_str		 = json.dump();
-		std::string json_sum_str = json_sum.dump();
+		// 事件放入队列的顺序与序号的顺序最多相差事件接收的线程数，窗口需要大于解析线程数与它之和，否则可能所有解析线程都在等待还在队列中的序号
+		reorder_window_ = std::max<uint64_t>(setting.queue_capacity, GetParseWorker() + std::max(setting.dispatch_worker, static_cast<size_t>(1)) + 1);
+		event_queue_.reset(new BoundedQueue<IntakeEvent>{setting.queue_capacity});
+		parsed_queue_.reset(new BoundedQueue<ParsedData>{setting.queue_capacity});
+		aggregated_queue_.reset(new BoundedQueue<AggregatedData>{setting.queue_capacity});
+		delivery_queue_.reset(new BoundedQueue<Delivery>{setting.queue_capacity});
+	}
 
-		// 遍历目标，发送数据
-		for (const auto& name_url: target) {
-			std::string str_copy;
-			if (name_url.second.sum) {
-				str_copy = json_sum_str;
-			} else {
-				str_copy = json_str;
+	size_t Application::GetParseWorker() const {
+		auto parse_worker = config_manager_.setting.parse_worker;
+		if (parse_worker == 0) {
+			parse_worker = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+		return parse_worker;
+	}
+
+	size_t Application::GetPipelineThreadCount() const {
+		const auto& setting = config_manager_.setting;
+		return GetParseWorker() +
+					 std::max(setting.aggregate_worker, static_cast<size_t>(1)) +
+					 std::max(setting.serialize_worker, static_cast<size_t>(1)) +
+					 std::max(setting.deliver_worker, static_cast<size_t>(1)) +
+					 (setting.pipeline_report_interval > 0 ? 1 : 0);
+	}
+
+	void Application::StartPipeline(std::vector<std::future<void>>& loops) {
+		const auto& setting = config_manager_.setting;
+
+		for (size_t i = 0; i < GetParseWorker(); ++i) {
+			loops.push_back(thread_->Submit(&Application::ParseStage, this));
+		}
+		for (size_t i = 0; i < std::max(setting.aggregate_worker, static_cast<size_t>(1)); ++i) {
+			loops.push_back(thread_->Submit(&Application::AggregateStage, this));
+		}
+		for (size_t i = 0; i < std::max(setting.serialize_worker, static_cast<size_t>(1)); ++i) {
+			loops.push_back(thread_->Submit(&Application::SerializeStage, this));
+		}
+		for (size_t i = 0; i < std::max(setting.deliver_worker, static_cast<size_t>(1)); ++i) {
+			loops.push_back(thread_->Submit(&Application::DeliverStage, this));
+		}
+		if (setting.pipeline_report_interval > 0) {
+			loops.push_back(thread_->Submit(&Application::ReportPipeline, this));
+		}
+	}
+
+	void Application::ParseStage() {
+		IntakeEvent event;
+		while (event_queue_->Pop(event)) {
+			{
+				// 前面的文件还没有聚合完时不再领先太多，否则后面的数据都会堆积在聚合阶段
+				auto&												 source = *event.source;
+				std::unique_lock<std::mutex> lock(source.mutex);
+				source.delivered_cv.wait(lock, [this, &source, &event] { return event.sequence < source.delivered + reorder_window_; });
+			}
+
+			std::pair<std::string, data::FileDataType> time_data;
+			try {
+				time_data = DoResolveData(*event.path_detail, event.filename, *event.dir_name, *event.plan);
+			} catch (const std::exception& e) {
+				LOG2FILE(LOG_LEVEL::ERROR, "Cannot resolve " + event.filename + ": " + e.what());
+			}
+
+			// 即使没有数据也要放入队列，否则聚合阶段会一直等待这个序号
+			parsed_queue_->Push({event.source, event.sequence, std::move(time_data.first), std::move(time_data.second)});
+		}
+	}
+
+	void Application::AggregateStage() {
+		ParsedData parsed;
+		while (parsed_queue_->Pop(parsed)) {
+			auto&												 source = *parsed.source;
+			std::unique_lock<std::mutex> lock(source.mutex);
+
+			auto												 sequence = parsed.sequence;
+			source.pending.emplace(sequence, std::move(parsed));
+
+			// 按照序号把已经到达的连续的部分移到ready中
+			for (auto it = source.pending.begin(); it != source.pending.end() && it->first == source.expected; it = source.pending.erase(it)) {
+				++source.expected;
+				source.ready.push_back(std::move(it->second));
 			}
 
-			// 替换要替换的字段名
-			// todo: 支持直接删除某个字段或者替换某个字段(在dump之前)
-			//    require: extract && insert (c++17)(字段名是key)
-			for (const auto& from_to: name_url.second.field_replace) {
-				auto pos = str_copy.find(from_to.first);
-				if (pos != std::string::npos) {
-					str_copy.replace(pos, from_to.first.length(), from_to.second);
+			// 其他线程正在交出时由它按照顺序交出
+			if (source.delivering) {
+				continue;
+			}
+			source.delivering = true;
+			while (!source.ready.empty()) {
+				auto ready = std::move(source.ready.front());
+				source.ready.pop_front();
+				// 文件已经处理过，没有新的数据或者解析失败(已经记录了日志)时只推进序号
+				if (!ready.time.empty() && !ready.data.empty()) {
+					// 队列满时等待，不持有锁，其他聚合线程依然可以处理这个源的数据
+					lock.unlock();
+					aggregated_queue_->Push({std::move(ready.time), std::move(ready.data)});
+					lock.lock();
 				}
+				source.delivered = ready.sequence + 1;
+				source.delivered_cv.notify_all();
 			}
+			source.delivering = false;
+		}
+	}
 
+	void Application::SerializeStage() {
+		// sum与field_replace相同的目标分为一组，每组只序列化一次，字段名在序列化时替换
+		std::vector<std::vector<const data::DataTarget*>> groups;
+		std::vector<JsonWriter::Output>										outputs;
+		for (const auto& name_url: config_manager_.target) {
+			const auto& target = name_url.second;
+			auto				it		 = std::find_if(groups.begin(), groups.end(), [&target](const std::vector<const data::DataTarget*>& group) {
+				 return group.front()->sum == target.sum && group.front()->field_replace == target.field_replace;
+			 });
+			if (it != groups.end()) {
+				it->push_back(&target);
+				continue;
+			}
+			groups.push_back({&target});
+			outputs.push_back({target.sum, &target.field_replace, nullptr});
+		}
+
+		// 每个线程一个writer，按照上一次的大小预留空间
+		JsonWriter							 writer;
+		std::vector<std::size_t> reserved(groups.size(), 0);
+		AggregatedData					 aggregated;
+		while (aggregated_queue_->Pop(aggregated)) {
+			std::vector<std::shared_ptr<std::string>> bodies;
+			for (std::size_t i = 0; i < groups.size(); ++i) {
+				bodies.push_back(std::make_shared<std::string>());
+				bodies.back()->reserve(reserved[i]);
+				outputs[i].out = bodies.back().get();
+			}
+			writer.Write(aggregated.time, aggregated.data, outputs);
+			// 序列化之后不再需要原始数据
+			data::FileDataType{}.swap(aggregated.data);
+
+			for (std::size_t i = 0; i < groups.size(); ++i) {
+				reserved[i] = bodies[i]->size();
+				for (const auto* target: groups[i]) {
+					delivery_queue_->Push({target, bodies[i]});
+				}
+			}
+		}
+	}
+
+	void Application::DeliverStage() {
+		Delivery delivery;
+		while (delivery_queue_->Pop(delivery)) {
 			// 发送数据
-			if (name_url.second.sum) {
-				//				work::net_manager::post_data_to_url(name_url.second.url, json_sum.dump());
-			} else {
-				//				work::net_manager::post_data_to_url(name_url.second.url, json.dump());
+			//			NetManager::PostDataToUrl(delivery.target->url, *delivery.body);
+		}
+	}
+
+	void Application::ReportPipeline() {
+		const auto interval = std::chrono::seconds(config_manager_.setting.pipeline_report_interval);
+
+		auto			 format		= [](const std::string& name, const QueueMetrics& metrics) {
+			 return name + ": " + std::to_string(metrics.size) + "/" + std::to_string(metrics.capacity) +
+							" peak " + std::to_string(metrics.peak) +
+							" pushed " + std::to_string(metrics.pushed) +
+							" popped " + std::to_string(metrics.popped) +
+							" blocked " + std::to_string(metrics.blocked);
+		};
+
+		for (;;) {
+			std::this_thread::sleep_for(interval);
+			auto dispatch = watchdog_.GetDispatchMetrics(true);
+			// 队列长期接近满说明下游阶段是瓶颈，blocked增长说明上游在等待
+			LOG2FILE(LOG_LEVEL::INFO,
+							 "Pipeline queues: " +
+									 format("dispatch", dispatch.queue) +
+									 " coalesced " + std::to_string(dispatch.coalesced) +
+									 " events " + std::to_string(dispatch.events) + " (" + std::to_string(dispatch.event_rate) + "/s)" +
+									 " overflows " + std::to_string(dispatch.overflows) +
+									 " latency avg " + std::to_string(dispatch.average_latency) + " us max " + std::to_string(dispatch.max_latency) + " us; " +
+									 format("parse", event_queue_->GetMetrics(true)) + "; " +
+									 format("aggregate", parsed_queue_->GetMetrics(true)) + "; " +
+									 format("serialize", aggregated_queue_->GetMetrics(true)) + "; " +
+									 format("deliver", delivery_queue_->GetMetrics(true)) + "; " +
+									 "log dropped " + std::to_string(GetDroppedLogCount()) +
+									 " suppressed " + std::to_string(GetSuppressedLogCount()));
+		}
+	}
+
+	void Application::DoIntake(
+			SourceState&											source,
+			const data::SourcePlan&						plan,
+			const std::string&								dir_name,
+			const data::DataSourcePathDetail& path_detail,
+			const std::string&								filename,
+			bool															skip_processed) {
+		auto full_path = FileManager::GetAbsolutePath(filename, dir_name);
+		if (DoMarkProcessed(full_path, DoGetFileSize(full_path)) && skip_processed) {
+			return;
+		}
+
+		// 只分配序号并放入队列，解析在解析阶段进行
+		event_queue_->Push({&path_detail, &dir_name, &plan, &source, source.next_sequence.fetch_add(1), filename});
+	}
+
+	void Application::DoRescan(
+			SourceState&											source,
+			const data::SourcePlan&						plan,
+			const std::string&								dir_name,
+			const data::DataSourcePathDetail& path_detail) {
+		auto files = FileManager::GetFilesInPath(
+				dir_name,
+				path_detail.recursive,
+				[&path_detail](const std::string& filename) -> bool {
+					return path_detail.IsFileValid(filename);
+				});
+
+		size_t count = 0;
+		for (const auto& file: files) {
+			// 以相同大小接收过的文件不需要再处理，追加模式下文件变大时只会解析新追加的部分
+			if (DoMarkProcessed(file, DoGetFileSize(file))) {
+				continue;
 			}
+			event_queue_->Push({&path_detail, &dir_name, &plan, &source, source.next_sequence.fetch_add(1), file});
+			++count;
 		}
+		LOG2FILE(LOG_LEVEL::WARNING, "Rescanned " + dir_name + ", " + std::to_string(count) + " of " + std::to_string(files.size()) + " files not processed yet");
 	}
 
-	void Application::DoResolveAndPostData(
-			const data::DataSourcePathDetail&	 path_detail,
-			const std::string&								 filename,
-			const std::string&								 dir_name,
-			const data::DataSourceFieldDetail& field_detail) const {
-		auto time_data = DoResolveData(path_detail, filename, dir_name, field_detail);
-		DoPostData(time_data.first, time_data.second, config_manager_.target);
+	bool Application::DoMarkProcessed(const std::string& full_path, uint64_t size) {
+		std::lock_guard<std::mutex> lock(processed_mutex_);
+		DoPruneMissingFiles(processed_, processed_prune_at_, [](uint64_t) { return true; });
+		auto it = processed_.find(full_path);
+		if (it != processed_.end() && it->second == size) {
+			return true;
+		}
+		processed_[full_path] = size;
+		return false;
+	}
+
+	void Application::DoForgetFile(const std::string& full_path) {
+		{
+			std::lock_guard<std::mutex> lock(processed_mutex_);
+			processed_.erase(full_path);
+		}
+		// 之后同名的新文件从头开始解析
+		std::lock_guard<std::mutex> lock(tail_mutex_);
+		tail_state_.erase(full_path);
+	}
+
+	void Application::SubmitParsedData(SourceState& source, std::pair<std::string, data::FileDataType>&& time_data) {
+		if (time_data.first.empty()) {
+			return;
+		}
+		parsed_queue_->Push({&source, source.next_sequence.fetch_add(1), std::move(time_data.first), std::move(time_data.second)});
 	}
 }// namespace work
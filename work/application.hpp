@@ -1,11 +1,29 @@
 #ifndef APPLICATION_HPP
 #define APPLICATION_HPP
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "bounded_queue.hpp"
 #include "data_form.hpp"
 #include "dir_watchdog.hpp"
 #include "file_manager.hpp"
+#include "source_plan.hpp"
 
 namespace work {
+	class ThreadManager;
+
+	/**
+	 * @brief 程序由以下几个阶段组成，相邻的阶段之间由有界队列连接：
+	 * 事件接收(watchdog线程) -> 解析文件 -> 聚合(按照顺序求和) -> 序列化 -> 发送
+	 * 每个阶段的线程数都可以配置，下游处理不过来时上游会在队列上等待
+	 */
 	class Application {
 	public:
 		/**
@@ -14,6 +32,8 @@ namespace work {
 		 */
 		explicit Application(std::string config_path);
 
+		~Application();
+
 		/**
 		 * @brief 初始化程序
 		 * @return 初始化是否成功
@@ -41,42 +61,188 @@ namespace work {
 		 * @brief 唤醒watchdog，进入监视状态
 		 */
 		void																							WakeUpWatchdog();
+		/**
+		 * @brief 根据配置创建流水线的队列以及每个源的状态
+		 */
+		void																							InitPipeline();
+		/**
+		 * @brief 在线程池中启动流水线中每个阶段的循环
+		 * @param loops 输出每个循环的结果，循环在流水线关闭之后结束
+		 */
+		void																							StartPipeline(std::vector<std::future<void>>& loops);
+		/**
+		 * @brief 获取解析阶段的线程数
+		 * @return 线程数
+		 */
+		size_t																						GetParseWorker() const;
+		/**
+		 * @brief 获取流水线中所有阶段一共占用的线程数
+		 * @return 线程数
+		 */
+		size_t																						GetPipelineThreadCount() const;
 
 		/**
-		 * @brief 解析文件
+		 * @brief 解析文件，追加模式的路径只解析上一次解析之后新追加的完整的行
 		 * @param path_detail 目标的路径详情
 		 * @param filename 目标文件
 		 * @param dir_name 目标所在目录
-		 * @param field_detail 目标的详细字段详情
+		 * @param plan 目标的解析计划
 		 * @param type 解析的类型
 		 * @return 数据时间戳与数据组成的pair
 		 */
-		static std::pair<std::string, data::FileDataType> DoResolveData(
+		std::pair<std::string, data::FileDataType> DoResolveData(
 				const data::DataSourcePathDetail&	 path_detail,
 				const std::string&								 filename,
 				const std::string&								 dir_name,
-				const data::DataSourceFieldDetail& field_detail);
+				const data::SourcePlan&					 plan) const;
 
 		/**
-		 * @brief post给予的数据
-		 * @param time 数据的时间戳，时间戳为空不进行post
-		 * @param data 数据，数据为空不进行post
+		 * @brief 追加模式下解析文件新追加的部分
+		 * @param plan 目标的解析计划
+		 * @param type 文件的类型
+		 * @param full_path 文件的绝对路径
+		 * @return 增量数据
 		 */
-		static void DoPostData(const std::string& time, const data::FileDataType& data, const data::TargetMapping& target);
+		data::FileDataType DoResolveAppendedData(
+				const data::SourcePlan&					 plan,
+				data::FILE_TYPE										 type,
+				const std::string&								 full_path) const;
+
+		struct SourceState;
 
 		/**
-		 * @brief 解析文件并且post
-		 * @param path_detail 目标的路径详情
-		 * @param filename 目标文件
-		 * @param dir_name 目标所在目录
-		 * @param field_detail 目标的详细字段详情
-		 * @param type 解析的类型
+		 * @brief 接收到的文件事件，由watchdog线程放入队列
+		 */
+		struct IntakeEvent {
+			const data::DataSourcePathDetail* path_detail;
+			const std::string*								dir_name;
+			const data::SourcePlan*						plan;
+			SourceState*											source;
+			// 在源中的序号
+			uint64_t													sequence;
+			std::string												filename;
+		};
+
+		/**
+		 * @brief 解析完成的数据，时间戳为空表示没有需要发送的数据(依然占用一个序号)
 		 */
-		void				DoResolveAndPostData(
-							 const data::DataSourcePathDetail&	path_detail,
-							 const std::string&									filename,
-							 const std::string&									dir_name,
-							 const data::DataSourceFieldDetail& field_detail) const;
+		struct ParsedData {
+			SourceState*			 source;
+			uint64_t					 sequence;
+			std::string				 time;
+			data::FileDataType data;
+		};
+
+		/**
+		 * @brief 一个源在流水线中的状态，用于保证同一个源的数据按照事件的顺序聚合
+		 */
+		struct SourceState {
+			// 下一个分配的序号
+			std::atomic<uint64_t>					 next_sequence{0};
+			// 保护下面的数据
+			std::mutex										 mutex;
+			// delivered增加时通知等待的解析线程
+			std::condition_variable				 delivered_cv;
+			// 下一个要聚合的序号
+			uint64_t											 expected = 0;
+			// 小于这个序号的数据都已经交给了序列化阶段，解析阶段最多领先reorder_window_个序号
+			uint64_t											 delivered = 0;
+			// 先于前面的序号解析完成的数据
+			std::map<uint64_t, ParsedData> pending;
+			// 已经按照序号排好，等待交给序列化阶段的数据
+			std::deque<ParsedData>				 ready;
+			// 是否有聚合线程正在交出ready中的数据，同一时间只有一个线程交出，保证顺序
+			bool													 delivering = false;
+		};
+
+		/**
+		 * @brief 聚合完成的数据
+		 */
+		struct AggregatedData {
+			std::string				 time;
+			data::FileDataType data;
+		};
+
+		/**
+		 * @brief 序列化完成，要发送给一个目标的数据
+		 */
+		struct Delivery {
+			const data::DataTarget*						 target;
+			// sum与field_replace相同的目标共享同一份数据
+			std::shared_ptr<const std::string> body;
+		};
+
+		/**
+		 * @brief 解析阶段，解析接收到的文件事件
+		 */
+		void ParseStage();
+		/**
+		 * @brief 聚合阶段，将同一个源的数据按照序号排序并求和
+		 */
+		void AggregateStage();
+		/**
+		 * @brief 序列化阶段，为每个目标生成要发送的数据
+		 */
+		void SerializeStage();
+		/**
+		 * @brief 发送阶段，将数据发送给目标
+		 */
+		void DeliverStage();
+		/**
+		 * @brief 定期输出流水线每个队列的统计信息
+		 */
+		void ReportPipeline();
+
+		/**
+		 * @brief 接收一个文件事件，分配序号并放入解析阶段的队列，队列满时等待
+		 * @param source 文件所属的源
+		 * @param plan 源的解析计划
+		 * @param dir_name 文件所在目录
+		 * @param path_detail 目录的路径详情
+		 * @param filename 文件名(递归监控时为相对路径)，已经校验过
+		 * @param skip_processed 文件已经以相同的大小接收过时是否跳过
+		 */
+		void DoIntake(
+				SourceState&											source,
+				const data::SourcePlan&						plan,
+				const std::string&								dir_name,
+				const data::DataSourcePathDetail& path_detail,
+				const std::string&								filename,
+				bool															skip_processed = false);
+
+		/**
+		 * @brief 事件丢失之后重新扫描目录，只接收没有处理过或者大小发生了变化的文件
+		 * @param source 目录所属的源
+		 * @param plan 源的解析计划
+		 * @param dir_name 目录
+		 * @param path_detail 目录的路径详情
+		 */
+		void DoRescan(
+				SourceState&											source,
+				const data::SourcePlan&						plan,
+				const std::string&								dir_name,
+				const data::DataSourcePathDetail& path_detail);
+
+		/**
+		 * @brief 记录一个已经接收的文件
+		 * @param full_path 文件的绝对路径
+		 * @param size 接收时文件的大小
+		 * @return 文件之前是否以相同的大小接收过
+		 */
+		bool DoMarkProcessed(const std::string& full_path, uint64_t size);
+
+		/**
+		 * @brief 文件被删除或者移走，移除它的记录
+		 * @param full_path 文件的绝对路径
+		 */
+		void DoForgetFile(const std::string& full_path);
+
+		/**
+		 * @brief 将已经解析完成的数据放入聚合阶段，分配一个新的序号
+		 * @param source 数据所属的源
+		 * @param time_data 数据时间戳与数据组成的pair，时间戳为空时不放入
+		 */
+		void SubmitParsedData(SourceState& source, std::pair<std::string, data::FileDataType>&& time_data);
 
 		// member data below
 
@@ -86,6 +252,42 @@ namespace work {
 		data::DataConfigManager config_manager_;
 		// 用于监控文件的watchdog
 		DirWatchdog							watchdog_;
+		// 所有线程所在的线程池，Run时创建
+		std::unique_ptr<ThreadManager> thread_;
+
+		/**
+		 * @brief 追加模式下一个文件的解析状态，同一个文件同时只能有一个线程解析
+		 */
+		struct TailState {
+			std::mutex								mutex;
+			FileManager::TailPosition position;
+		};
+		// 保护tail_state_
+		mutable std::mutex																									 tail_mutex_;
+		// 追加模式下文件的绝对路径 <-> 文件的解析状态
+		mutable std::unordered_map<std::string, std::shared_ptr<TailState>> tail_state_;
+		// tail_state_达到这个数量时移除已经不存在的文件的状态
+		mutable std::size_t																									 tail_prune_at_ = 1024;
+
+		// 保护processed_
+		std::mutex																													 processed_mutex_;
+		// 已经接收的文件的绝对路径 <-> 接收时文件的大小，用于事件丢失之后重新扫描时去重
+		std::unordered_map<std::string, uint64_t>													 processed_;
+		// processed_达到这个数量时移除已经不存在的文件的记录
+		std::size_t																													 processed_prune_at_ = 1024;
+
+		// 源的名字 <-> 源在流水线中的状态
+		std::unordered_map<std::string, std::unique_ptr<SourceState>>				 source_state_;
+		// 同一个源中等待重排的最大序号范围，限制解析快于聚合时堆积的数据
+		uint64_t																													 reorder_window_ = 0;
+		// 事件接收 -> 解析
+		std::unique_ptr<BoundedQueue<IntakeEvent>>												 event_queue_;
+		// 解析 -> 聚合
+		std::unique_ptr<BoundedQueue<ParsedData>>													 parsed_queue_;
+		// 聚合 -> 序列化
+		std::unique_ptr<BoundedQueue<AggregatedData>>										 aggregated_queue_;
+		// 序列化 -> 发送
+		std::unique_ptr<BoundedQueue<Delivery>>														 delivery_queue_;
 	};
 }// namespace work
 
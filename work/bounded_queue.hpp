@@ -0,0 +1,143 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+namespace work {
+	/**
+	 * @brief 队列的统计信息
+	 */
+	struct QueueMetrics {
+		// 当前的元素数
+		std::size_t size;
+		// 容量
+		std::size_t capacity;
+		// 上一次重置之后的最大元素数
+		std::size_t peak;
+		// 累计放入的元素数
+		uint64_t		pushed;
+		// 累计取出的元素数
+		uint64_t		popped;
+		// 累计因为队列满而等待的Push次数
+		uint64_t		blocked;
+	};
+
+	/**
+	 * @brief 有界的阻塞队列，用于连接流水线中相邻的两个阶段
+	 * 队列满时Push阻塞(背压)，队列空时Pop阻塞，关闭之后不再接受新元素，已有的元素依然可以取出
+	 * @tparam T 元素类型
+	 */
+	template<typename T>
+	class BoundedQueue {
+	public:
+		using value_type = T;
+		using size_type	 = std::size_t;
+
+		/**
+		 * @brief 构造队列
+		 * @param capacity 容量，至少为1
+		 */
+		explicit BoundedQueue(size_type capacity)
+			: capacity_(capacity == 0 ? 1 : capacity) {}
+
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		/**
+		 * @brief 放入一个元素，队列满时等待
+		 * @param value 元素
+		 * @return 是否放入，队列已经关闭时返回false
+		 */
+		bool Push(value_type value) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			if (!closed_ && queue_.size() >= capacity_) {
+				++blocked_;
+				not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+			}
+			if (closed_) {
+				return false;
+			}
+
+			queue_.push_back(std::move(value));
+			++pushed_;
+			if (queue_.size() > peak_) {
+				peak_ = queue_.size();
+			}
+			lock.unlock();
+			not_empty_.notify_one();
+			return true;
+		}
+
+		/**
+		 * @brief 取出一个元素，队列空时等待
+		 * @param value 取出的元素
+		 * @return 是否取出，队列已经关闭并且为空时返回false
+		 */
+		bool Pop(value_type& value) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+			if (queue_.empty()) {
+				return false;
+			}
+
+			value = std::move(queue_.front());
+			queue_.pop_front();
+			++popped_;
+			lock.unlock();
+			not_full_.notify_one();
+			return true;
+		}
+
+		/**
+		 * @brief 关闭队列，唤醒所有等待的线程
+		 */
+		void Close() {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				closed_ = true;
+			}
+			not_full_.notify_all();
+			not_empty_.notify_all();
+		}
+
+		/**
+		 * @brief 获取当前的元素数
+		 * @return 元素数
+		 */
+		size_type Size() const {
+			std::lock_guard<std::mutex> lock(mutex_);
+			return queue_.size();
+		}
+
+		/**
+		 * @brief 获取统计信息
+		 * @param reset_peak 是否将最大元素数重置为当前的元素数
+		 * @return 统计信息
+		 */
+		QueueMetrics GetMetrics(bool reset_peak = false) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			QueueMetrics								ret{queue_.size(), capacity_, peak_, pushed_, popped_, blocked_};
+			if (reset_peak) {
+				peak_ = queue_.size();
+			}
+			return ret;
+		}
+
+	private:
+		mutable std::mutex			mutex_;
+		std::condition_variable not_full_;
+		std::condition_variable not_empty_;
+		std::deque<value_type>	queue_;
+		const size_type					capacity_;
+		bool										closed_	 = false;
+		size_type								peak_		 = 0;
+		uint64_t								pushed_	 = 0;
+		uint64_t								popped_	 = 0;
+		uint64_t								blocked_ = 0;
+	};
+}// namespace work
+
+#endif//BOUNDED_QUEUE_HPP
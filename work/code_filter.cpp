@@ -0,0 +1,121 @@
+#include "code_filter.hpp"
+
+#include <algorithm>
+
+namespace work {
+	namespace data {
+		CodeFilter::CodeFilter(const DataSourceCodeDetail& detail)
+			: exclude_(detail.exclude),
+				kind_(KIND::NONE),
+				bitmap_base_(0),
+				ranges_(detail.ranges),
+				match_size_(0) {
+			// 合并重叠(或者相邻)的范围，方便二分查找
+			for (auto& range: ranges_) {
+				if (range.first > range.second) {
+					std::swap(range.first, range.second);
+				}
+			}
+			std::sort(ranges_.begin(), ranges_.end());
+			std::vector<range_type> merged;
+			for (const auto& range: ranges_) {
+				if (!merged.empty() && (merged.back().second == static_cast<value_type>(-1) || range.first <= merged.back().second + 1)) {
+					merged.back().second = std::max(merged.back().second, range.second);
+				} else {
+					merged.push_back(range);
+				}
+			}
+			ranges_.swap(merged);
+			for (const auto& range: ranges_) {
+				match_size_ += static_cast<double>(range.second - range.first) + 1;
+			}
+
+			std::vector<value_type> values = detail.values;
+			std::sort(values.begin(), values.end());
+			values.erase(std::unique(values.begin(), values.end()), values.end());
+			match_size_ += static_cast<double>(values.size());
+			if (values.empty()) {
+				return;
+			}
+
+			auto span = values.back() - values.front();
+			if (values.size() > max_sorted_size && span < max_bitmap_bits && span < values.size() * max_bits_per_value) {
+				kind_				 = KIND::BITMAP;
+				bitmap_base_ = values.front();
+				bitmap_.assign(static_cast<size_type>(span / 64 + 1), 0);
+				for (auto value: values) {
+					auto offset = value - bitmap_base_;
+					bitmap_[static_cast<size_type>(offset / 64)] |= static_cast<uint64_t>(1) << (offset % 64);
+				}
+			} else if (values.size() > max_sorted_size) {
+				kind_ = KIND::HASH_SET;
+				hash_.reserve(values.size());
+				hash_.insert(values.cbegin(), values.cend());
+			} else {
+				kind_		= KIND::SORTED_ARRAY;
+				sorted_ = std::move(values);
+			}
+		}
+
+		double CodeFilter::GetCost() const {
+			double cost = 0;
+			switch (kind_) {
+				case KIND::NONE:
+					break;
+				case KIND::BITMAP:
+					cost += 1;
+					break;
+				case KIND::SORTED_ARRAY:
+					cost += 2;
+					break;
+				case KIND::HASH_SET:
+					cost += 4;
+					break;
+			}
+			if (!ranges_.empty()) {
+				cost += 2;
+			}
+			// 至少需要读取并解析这一列
+			return cost + 1;
+		}
+
+		double CodeFilter::GetRejectRate() const {
+			if (kind_ == KIND::NONE && ranges_.empty()) {
+				// 包含空集合拒绝所有行，排除空集合接受所有行(只校验这一列是否合法)
+				return exclude_ ? 0 : 1;
+			}
+			// 没有统计信息，假设值均匀分布在assumed_domain_size个不同值中，候选值越多匹配的概率越大
+			auto match = match_size_ / (match_size_ + assumed_domain_size);
+			return exclude_ ? match : 1 - match;
+		}
+
+		bool CodeFilter::Match(value_type value) const {
+			bool found = false;
+			switch (kind_) {
+				case KIND::NONE:
+					break;
+				case KIND::SORTED_ARRAY:
+					found = std::binary_search(sorted_.cbegin(), sorted_.cend(), value);
+					break;
+				case KIND::HASH_SET:
+					found = hash_.find(value) != hash_.end();
+					break;
+				case KIND::BITMAP:
+					if (value >= bitmap_base_) {
+						auto offset = value - bitmap_base_;
+						auto index	= offset / 64;
+						found				= index < bitmap_.size() && (bitmap_[static_cast<size_type>(index)] >> (offset % 64)) & 1;
+					}
+					break;
+			}
+
+			if (found || ranges_.empty()) {
+				return found;
+			}
+
+			// 找到第一个起点大于value的范围，value只可能落在它前面的那个范围中
+			auto it = std::upper_bound(ranges_.cbegin(), ranges_.cend(), value, [](value_type v, const range_type& range) { return v < range.first; });
+			return it != ranges_.cbegin() && value <= (it - 1)->second;
+		}
+	}// namespace data
+}// namespace work
@@ -0,0 +1,106 @@
+#ifndef CODE_FILTER_HPP
+#define CODE_FILTER_HPP
+
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "data_form.hpp"
+
+namespace work {
+	namespace data {
+		/**
+		 * @brief 由DataSourceCodeDetail编译得到的过滤器，根据候选值集合的形状选择表示方式
+		 * 少量的值使用有序数组，大量的值使用哈希集合，分布在较小范围内的密集值使用位图
+		 */
+		class CodeFilter {
+		public:
+			using value_type = DataSourceCodeDetail::value_type;
+			using size_type	 = DataSourceCodeDetail::size_type;
+			using range_type = DataSourceCodeDetail::range_type;
+
+			enum class KIND {
+				// 没有候选值(只有范围或者什么都没有)
+				NONE,
+				SORTED_ARRAY,
+				HASH_SET,
+				BITMAP
+			};
+
+			/**
+			 * @brief 不超过这个数量的候选值使用有序数组
+			 */
+			constexpr static size_type max_sorted_size = 64;
+			/**
+			 * @brief 位图最多的位数(1MB)
+			 */
+			constexpr static size_type max_bitmap_bits = 1 << 23;
+			/**
+			 * @brief 位图平均每个候选值最多占用的位数，超过说明值太稀疏
+			 */
+			constexpr static size_type max_bits_per_value = 64;
+			/**
+			 * @brief 估计拒绝概率时假设一列中出现的不同值的个数(没有统计信息时的固定假设)
+			 */
+			constexpr static double		 assumed_domain_size = 1024;
+
+			/**
+			 * @brief 编译过滤器
+			 * @param detail code的详情
+			 */
+			explicit CodeFilter(const DataSourceCodeDetail& detail);
+
+			/**
+			 * @brief 当前的值是否是可接受的，与DataSourceCodeDetail::Accept结果一致
+			 * @param value 当前的值
+			 * @return 是否可接受
+			 */
+			bool			Accept(value_type value) const { return Match(value) != exclude_; }
+
+			/**
+			 * @brief 获取所选择的表示方式
+			 * @return 表示方式
+			 */
+			KIND			GetKind() const { return kind_; }
+
+			/**
+			 * @brief 估计一次判断的相对开销
+			 * @return 相对开销，越小越便宜
+			 */
+			double		GetCost() const;
+
+			/**
+			 * @brief 估计一行被这个过滤器拒绝的概率，由候选值的个数与合并之后的范围宽度得到，
+			 * 假设这一列的值在assumed_domain_size个不同值中均匀分布
+			 * @return 拒绝的概率，越大越有选择性
+			 */
+			double		GetRejectRate() const;
+
+		private:
+			/**
+			 * @brief 值是否存在于候选值或者候选范围中
+			 * @param value 当前的值
+			 * @return 是否存在
+			 */
+			bool			Match(value_type value) const;
+
+			// 排除值还是包含值
+			bool														 exclude_;
+			// 所选择的表示方式
+			KIND														 kind_;
+			// 有序数组
+			std::vector<value_type>					 sorted_;
+			// 哈希集合
+			std::unordered_set<value_type>	 hash_;
+			// 位图，第i位表示 bitmap_base_ + i 是否存在
+			std::vector<uint64_t>						 bitmap_;
+			value_type											 bitmap_base_;
+			// 候选范围(闭区间)，已经排序并且合并了重叠的范围
+			std::vector<range_type>					 ranges_;
+			// 候选值与候选范围中值的总数，用于估计选择性
+			double													 match_size_;
+		};
+	}// namespace data
+}// namespace work
+
+#endif//CODE_FILTER_HPP
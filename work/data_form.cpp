@@ -3,6 +3,9 @@
 #include <boost/regex.hpp>
 
 #include "error_logger.hpp"
+#include "filename_matcher.hpp"
+#include "number_parser.hpp"
+#include "source_plan.hpp"
 
 namespace work {
 	namespace data {
@@ -40,10 +43,18 @@ namespace work {
 		}
 
 		std::pair<bool, std::string> StartTimeDetail::GetTargetFullTime(const std::string& time_str, const std::string& folder_str) const {
-			auto time = stoull(time_str, nullptr);
+			// 正则表达式只编译一次，const的boost::regex可以在多个线程中同时使用
+			static const boost::regex year_mon_day_pattern(R"(\b(\d{8})\b)");
+			static const boost::regex year_pattern(R"(\b(\d{4})\b)");
+
+			uint64_t time = 0;
+			if (!ParseUnsigned(time_str, time)) {
+				LOG2FILE(LOG_LEVEL::ERROR, "Invalid time: " + time_str);
+				return std::make_pair(false, "");
+			}
 			if (time_str.length() == 4) {
 				// time = hour + min
-				boost::regex	pattern(R"(\b(\d{8})\b)");
+				const auto&		pattern = year_mon_day_pattern;
 				boost::smatch result;
 				if (!boost::regex_search(folder_str, result, pattern)) {
 					LOG2FILE(LOG_LEVEL::ERROR, "Invalid directory: " + folder_str);
@@ -56,7 +67,7 @@ namespace work {
 				}
 			} else if (time_str.length() == 8) {
 				// time = mon + day + hour + min
-				boost::regex	pattern(R"(\b(\d{4})\b)");
+				const auto&		pattern = year_pattern;
 				boost::smatch result;
 				if (!boost::regex_search(folder_str, result, pattern)) {
 					LOG2FILE(LOG_LEVEL::ERROR, "Invalid directory: " + folder_str);
@@ -78,22 +89,55 @@ namespace work {
 		}
 
 		bool DataSourceCodeDetail::Accept(value_type value) const {
-			if (exclude) {
-				return std::none_of(values.cbegin(), values.cend(), [&](value_type v) { return v == value; });
-			} else {
-				return std::any_of(values.cbegin(), values.cend(), [&](value_type v) { return v == value; });
-			}
+			// 解析时使用由此编译得到的CodeFilter，这里保留线性查找的实现作为参照
+			auto match = [value](value_type v) { return v == value; };
+			auto in		 = [value](const range_type& range) {
+				 return std::min(range.first, range.second) <= value && value <= std::max(range.first, range.second);
+			};
+			bool found = std::any_of(values.cbegin(), values.cend(), match) || std::any_of(ranges.cbegin(), ranges.cend(), in);
+			return exclude ? !found : found;
+		}
+
+		void from_json(const nlohmann::json& j, DataSource& data) {
+			j.at("path").get_to(data.path);
+			j.at("detail").get_to(data.detail);
+			// 载入配置时编译解析计划，解析时不再访问原始配置
+			data.plan = std::make_shared<const SourcePlan>(SourcePlan::Compile(data.detail));
+		}
+
+		void to_json(nlohmann::json& j, const DataSource& data) {
+			j["path"]		= data.path;
+			j["detail"] = data.detail;
+		}
+
+		void from_json(const nlohmann::json& j, DataSourcePathDetail& data) {
+			j.at("start_time").get_to(data.start_time);
+			j.at("filename_pattern").get_to(data.filename_pattern);
+			j.at("type").get_to(data.type);
+			j.at("recursive").get_to(data.recursive);
+			// 可选字段
+			data.tail					 = j.value("tail", false);
+			data.watch_backend = j.value("watch_backend", std::string{"inotify"});
+			// 载入配置时编译，匹配文件名时不再重复编译正则表达式
+			data.matcher = std::make_shared<const FilenameMatcher>(data.filename_pattern);
 		}
 
 		bool DataSourcePathDetail::IsFileValid(const std::string& filename) const {
-			return boost::regex_search(filename, boost::regex{filename_pattern});
+			if (!matcher) {
+				return FilenameMatcher{filename_pattern}.Search(filename);
+			}
+			return matcher->Search(filename);
 		}
 
 		std::string DataSourcePathDetail::GetFileTimeStr(const std::string& filename) const {
-			boost::smatch result;
+			std::string result;
 			// 在获取文件时一定会先 IsFileValid 判断，所以必定有结果
-			boost::regex_search(filename, result, boost::regex{filename_pattern});
-			return result[1];
+			if (!matcher) {
+				FilenameMatcher{filename_pattern}.Search(filename, &result);
+			} else {
+				matcher->Search(filename, &result);
+			}
+			return result;
 		}
 
 		void BasicData::Increase(size_type layer, FILE_TYPE name, value_type price, value_type count) {
@@ -118,6 +162,19 @@ namespace work {
 			}
 		}
 
+		void BasicData::Merge(const BasicData& other) {
+			for (size_type i = 0; i < bound; ++i) {
+				wins[i] += other.wins[i];
+				imps[i] += other.imps[i];
+				clks[i] += other.clks[i];
+				cost[i] += other.cost[i];
+			}
+
+			if (!pad_json) {
+				pad_json = other.pad_json;
+			}
+		}
+
 		BasicData::operator BasicDataSum() const {
 			return {
 					std::accumulate(wins.cbegin(), wins.cend(), static_cast<value_type>(0)),
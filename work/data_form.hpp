@@ -3,6 +3,7 @@
 
 #include <array>
 #include <cstdint>
+#include <memory>
 #include <unordered_map>
 
 #include "data_form_fwd.hpp"
@@ -97,6 +98,7 @@ namespace work {
 		struct DataSourceCodeDetail {
 			using size_type	 = size_t;
 			using value_type = uint64_t;
+			using range_type = std::pair<value_type, value_type>;
 
 			/**
 			 * @brief 目标在哪一列
@@ -110,6 +112,10 @@ namespace work {
 			 * @brief 候选的值
 			 */
 			std::vector<value_type> values;
+			/**
+			 * @brief 候选的范围(闭区间)，可选，值落在任意一个范围中等同于存在于候选的值中
+			 */
+			std::vector<range_type> ranges;
 
 			/**
 			 * @brief 当前的值是否是可接受的
@@ -118,7 +124,21 @@ namespace work {
 			 */
 			bool										Accept(value_type value) const;
 		};
-		NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(DataSourceCodeDetail, column, exclude, values);
+
+		inline void from_json(const nlohmann::json& j, DataSourceCodeDetail& data) {
+			j.at("column").get_to(data.column);
+			j.at("exclude").get_to(data.exclude);
+			j.at("values").get_to(data.values);
+			// 可选字段
+			data.ranges = j.value("ranges", std::vector<DataSourceCodeDetail::range_type>{});
+		}
+
+		inline void to_json(nlohmann::json& j, const DataSourceCodeDetail& data) {
+			j["column"]	 = data.column;
+			j["exclude"] = data.exclude;
+			j["values"]	 = data.values;
+			j["ranges"]	 = data.ranges;
+		}
 
 		struct DataSourceFieldDetail {
 			using size_type	 = size_t;
@@ -145,8 +165,31 @@ namespace work {
 			 * @brief 那些字段要填充数据
 			 */
 			std::vector<std::string>															pad_field_name;
+
+			/**
+			 * @brief 解析单个文件时使用的线程数，可选，默认为1(不并行)
+			 */
+			size_type																							parse_thread = 1;
 		};
-		NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(DataSourceFieldDetail, code, field, layer, pad_data, pad_field_name)
+
+		inline void from_json(const nlohmann::json& j, DataSourceFieldDetail& data) {
+			j.at("code").get_to(data.code);
+			j.at("field").get_to(data.field);
+			j.at("layer").get_to(data.layer);
+			j.at("pad_data").get_to(data.pad_data);
+			j.at("pad_field_name").get_to(data.pad_field_name);
+			// 可选字段
+			data.parse_thread = j.value("parse_thread", static_cast<DataSourceFieldDetail::size_type>(1));
+		}
+
+		inline void to_json(nlohmann::json& j, const DataSourceFieldDetail& data) {
+			j["code"]						= data.code;
+			j["field"]					= data.field;
+			j["layer"]					= data.layer;
+			j["pad_data"]				= data.pad_data;
+			j["pad_field_name"] = data.pad_field_name;
+			j["parse_thread"]		= data.parse_thread;
+		}
 
 		struct DataSourcePathDetail {
 			/**
@@ -168,11 +211,27 @@ namespace work {
 			 * 且不会从该子文件夹名字获取任何信息
 			 */
 			bool						recursive;
+			/**
+			 * @brief 是否为追加模式，可选，默认为false
+			 * 追加模式下文件每次被修改时只解析新追加的完整的行并发送增量，而不是等文件被移动到目录中后整个解析
+			 */
+			bool						tail = false;
+			/**
+			 * @brief 监控文件夹的方式，可选，默认为"inotify"
+			 * 为"poll"时定期扫描文件夹，用于inotify不会产生事件的文件系统(NFS、FUSE等)
+			 */
+			std::string			watch_backend = "inotify";
+
+			/**
+			 * @brief 由filename_pattern编译得到的匹配器，载入配置时创建，不序列化
+			 * 只读，可以在多个线程中共享
+			 */
+			std::shared_ptr<const FilenameMatcher> matcher;
 
 			/**
 			 * @brief 目标文件名是否合法
 			 * @param filename 目标文件名
-			  const* @return 是否合法
+			 * @return 是否合法
 			 */
 			bool						IsFileValid(const std::string& filename) const;
 
@@ -183,7 +242,15 @@ namespace work {
 			 */
 			std::string			GetFileTimeStr(const std::string& filename) const;
 		};
-		NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(DataSourcePathDetail, start_time, filename_pattern, type, recursive)
+
+		inline void to_json(nlohmann::json& j, const DataSourcePathDetail& data) {
+			j["start_time"]				= data.start_time;
+			j["filename_pattern"] = data.filename_pattern;
+			j["type"]							= data.type;
+			j["recursive"]				= data.recursive;
+			j["tail"]							= data.tail;
+			j["watch_backend"]		= data.watch_backend;
+		}
 
 		struct DataSource {
 			using DataSourcePath = std::unordered_map<std::string, DataSourcePathDetail>;
@@ -195,13 +262,137 @@ namespace work {
 			/**
 			 * @brief 子文件内容的解释详情(如何解析)
 			 */
-			DataSourceFieldDetail detail;
+			DataSourceFieldDetail							detail;
+			/**
+			 * @brief 载入配置时由detail编译得到的解析计划，不参与序列化
+			 */
+			std::shared_ptr<const SourcePlan> plan;
 		};
-		NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(DataSource, path, detail)
 
 		using SourceMapping = std::unordered_map<std::string, DataSource>;
 		using TargetMapping = std::unordered_map<std::string, DataTarget>;
 
+		struct DataSetting {
+			using size_type = size_t;
+
+			/**
+			 * @brief 处理已有文件时的最大并发数，可选，默认为0(使用硬件线程数)
+			 */
+			size_type backfill_thread					 = 0;
+			/**
+			 * @brief 处理已有文件时输出进度的间隔(秒)，可选，默认为10
+			 */
+			size_type backfill_report_interval = 10;
+
+			/**
+			 * @brief 流水线中每个阶段之间的队列的容量，可选，默认为64，队列满时上一个阶段等待(背压)
+			 */
+			size_type queue_capacity					 = 64;
+			/**
+			 * @brief 执行watchdog回调函数(事件接收阶段)的线程数，可选，默认为1，大于1时不保证同一个源的事件按顺序接收
+			 */
+			size_type dispatch_worker					 = 1;
+			/**
+			 * @brief watchdog合并同一个文件的重复事件的静默时间(毫秒)，可选，默认为100，为0时不合并
+			 */
+			size_type coalesce_window					 = 100;
+			/**
+			 * @brief 解析阶段的线程数，可选，默认为0(使用硬件线程数)
+			 */
+			size_type parse_worker						 = 0;
+			/**
+			 * @brief 聚合阶段的线程数，可选，默认为1
+			 */
+			size_type aggregate_worker				 = 1;
+			/**
+			 * @brief 序列化阶段的线程数，可选，默认为1，大于1时不保证同一个源的数据按顺序发送
+			 */
+			size_type serialize_worker				 = 1;
+			/**
+			 * @brief 发送阶段的线程数，可选，默认为1，大于1时不保证同一个源的数据按顺序发送
+			 */
+			size_type deliver_worker					 = 1;
+			/**
+			 * @brief 输出流水线统计信息(队列深度等)的间隔(秒)，可选，默认为60，为0时不输出
+			 */
+			size_type pipeline_report_interval = 60;
+			/**
+			 * @brief 以"poll"方式监控的文件夹的最短扫描间隔(毫秒)，可选，默认为1000，发现变化时使用
+			 */
+			size_type poll_min_interval				 = 1000;
+			/**
+			 * @brief 以"poll"方式监控的文件夹的最长扫描间隔(毫秒)，可选，默认为16000，没有变化时间隔逐渐加倍直到这个值
+			 */
+			size_type poll_max_interval				 = 16000;
+			/**
+			 * @brief 输出的最低日志级别，可选，默认为"info"，可以为"info"、"warning"、"error"，更低级别的日志不会求值参数
+			 */
+			std::string log_level							 = "info";
+			/**
+			 * @brief 后台线程写出日志的间隔(毫秒)，可选，默认为200
+			 */
+			size_type log_flush_interval			 = 200;
+			/**
+			 * @brief 每个线程的日志缓冲区能够容纳的日志条数，可选，默认为4096
+			 */
+			size_type log_buffer_size					 = 4096;
+			/**
+			 * @brief 日志缓冲区满时的处理方式，可选，默认为"block"(等待写出)，为"drop"时丢弃并计数
+			 */
+			std::string log_overflow					 = "block";
+			/**
+			 * @brief 日志的输出格式，可选，默认为"text"，为"binary"时写入二进制文件，用log_decoder转换为文本
+			 */
+			std::string log_format						 = "text";
+			/**
+			 * @brief 每个级别("info"、"warning"、"error")每个调用位置每秒最多输出的日志条数，可选，没有指定的级别为0(不限制)
+			 */
+			std::unordered_map<std::string, size_type> log_rate_limit;
+		};
+
+		inline void from_json(const nlohmann::json& j, DataSetting& data) {
+			// 所有字段都是可选的
+			data.backfill_thread					= j.value("backfill_thread", static_cast<DataSetting::size_type>(0));
+			data.backfill_report_interval = j.value("backfill_report_interval", static_cast<DataSetting::size_type>(10));
+			data.queue_capacity						= j.value("queue_capacity", static_cast<DataSetting::size_type>(64));
+			data.dispatch_worker					= j.value("dispatch_worker", static_cast<DataSetting::size_type>(1));
+			data.coalesce_window					= j.value("coalesce_window", static_cast<DataSetting::size_type>(100));
+			data.parse_worker							= j.value("parse_worker", static_cast<DataSetting::size_type>(0));
+			data.aggregate_worker					= j.value("aggregate_worker", static_cast<DataSetting::size_type>(1));
+			data.serialize_worker					= j.value("serialize_worker", static_cast<DataSetting::size_type>(1));
+			data.deliver_worker						= j.value("deliver_worker", static_cast<DataSetting::size_type>(1));
+			data.pipeline_report_interval = j.value("pipeline_report_interval", static_cast<DataSetting::size_type>(60));
+			data.poll_min_interval				= j.value("poll_min_interval", static_cast<DataSetting::size_type>(1000));
+			data.poll_max_interval				= j.value("poll_max_interval", static_cast<DataSetting::size_type>(16000));
+			data.log_level								= j.value("log_level", std::string{"info"});
+			data.log_flush_interval				= j.value("log_flush_interval", static_cast<DataSetting::size_type>(200));
+			data.log_buffer_size					= j.value("log_buffer_size", static_cast<DataSetting::size_type>(4096));
+			data.log_overflow							= j.value("log_overflow", std::string{"block"});
+			data.log_format								= j.value("log_format", std::string{"text"});
+			data.log_rate_limit						= j.value("log_rate_limit", std::unordered_map<std::string, DataSetting::size_type>{});
+		}
+
+		inline void to_json(nlohmann::json& j, const DataSetting& data) {
+			j["backfill_thread"]					= data.backfill_thread;
+			j["backfill_report_interval"] = data.backfill_report_interval;
+			j["queue_capacity"]						= data.queue_capacity;
+			j["dispatch_worker"]					= data.dispatch_worker;
+			j["coalesce_window"]					= data.coalesce_window;
+			j["parse_worker"]							= data.parse_worker;
+			j["aggregate_worker"]					= data.aggregate_worker;
+			j["serialize_worker"]					= data.serialize_worker;
+			j["deliver_worker"]						= data.deliver_worker;
+			j["pipeline_report_interval"] = data.pipeline_report_interval;
+			j["poll_min_interval"]				= data.poll_min_interval;
+			j["poll_max_interval"]				= data.poll_max_interval;
+			j["log_level"]								= data.log_level;
+			j["log_flush_interval"]				= data.log_flush_interval;
+			j["log_buffer_size"]					= data.log_buffer_size;
+			j["log_overflow"]							= data.log_overflow;
+			j["log_format"]								= data.log_format;
+			j["log_rate_limit"]						= data.log_rate_limit;
+		}
+
 		struct DataConfigManager {
 			/**
 			 * @brief 源的集合，源的名字 <-> 源的信息
@@ -211,8 +402,26 @@ namespace work {
 			 * @brief 目标的集合，目标的名字 <-> 目标的信息
 			 */
 			SourceMapping source;
+			/**
+			 * @brief 全局设置，可选
+			 */
+			DataSetting		setting;
 		};
-		NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(DataConfigManager, target, source)
+
+		inline void from_json(const nlohmann::json& j, DataConfigManager& data) {
+			j.at("target").get_to(data.target);
+			j.at("source").get_to(data.source);
+			// 可选字段
+			if (j.contains("setting")) {
+				j.at("setting").get_to(data.setting);
+			}
+		}
+
+		inline void to_json(nlohmann::json& j, const DataConfigManager& data) {
+			j["target"]	 = data.target;
+			j["source"]	 = data.source;
+			j["setting"] = data.setting;
+		}
 
 		struct BasicData {
 			using value_type								 = DataSourceFieldDetail::value_type;
@@ -226,7 +435,10 @@ namespace work {
 			DataLayer			 clks;
 			DataLayer			 cost;
 
-			nlohmann::json pad_json;
+			/**
+			 * @brief 填充的数据，由解析计划共享，为空表示不填充
+			 */
+			std::shared_ptr<const nlohmann::json> pad_json;
 
 			/**
 			 * @brief 数据累计
@@ -237,6 +449,12 @@ namespace work {
 			 */
 			void					 Increase(size_type layer, FILE_TYPE name, value_type price = 0, value_type count = 1);
 
+			/**
+			 * @brief 合并另一份数据(例如并行解析同一个文件得到的部分结果)
+			 * @param other 要合并的数据
+			 */
+			void					 Merge(const BasicData& other);
+
 			/**
 			 * @brief 转换为求和的的数据
 			 * @return 求和的数据
@@ -291,8 +509,8 @@ namespace work {
 					{clks_name, data.clks},
 					{cost_name, data.cost}};
 
-			if (!data.pad_json.empty()) {
-				j.merge_patch(data.pad_json);
+			if (data.pad_json && !data.pad_json->empty()) {
+				j.merge_patch(*data.pad_json);
 			}
 		}
 
@@ -4,6 +4,8 @@
 #include "json_fwd.hpp"
 
 namespace work {
+	class FilenameMatcher;
+
 	namespace data {
 		constexpr static const char* wins_name		 = "wins";
 		constexpr static const char* imps_name		 = "imps";
@@ -42,7 +44,9 @@ namespace work {
 		struct DataSourceFieldDetail;
 		struct DataSourcePathDetail;
 		struct DataSource;
+		struct DataSetting;
 		struct DataConfigManager;
+		struct SourcePlan;
 
 		struct BasicData;
 		struct BasicDataSum;
@@ -59,6 +63,8 @@ namespace work {
 		void to_json(nlohmann::json& j, const DataSourcePathDetail& data);
 		void from_json(const nlohmann::json& j, DataSource& data);
 		void to_json(nlohmann::json& j, const DataSource& data);
+		void from_json(const nlohmann::json& j, DataSetting& data);
+		void to_json(nlohmann::json& j, const DataSetting& data);
 		void from_json(const nlohmann::json& j, DataConfigManager& data);
 		void to_json(nlohmann::json& j, const DataConfigManager& data);
 
@@ -0,0 +1,139 @@
+#include "delimiter_scanner.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WORK_SCANNER_X86 1
+#include <immintrin.h>
+#else
+#define WORK_SCANNER_X86 0
+#endif
+
+namespace {
+	using size_type			= work::DelimiterScanner::size_type;
+	using position_type = work::DelimiterScanner::position_type;
+
+	/**
+	 * @brief 扫描函数的类型
+	 * @param data 缓冲区
+	 * @param size 缓冲区大小
+	 * @param delimiter 分隔符
+	 * @param out 输出的位置
+	 * @return 位置的个数
+	 */
+	using scan_function_type = size_type (*)(const char* data, size_type size, char delimiter, position_type* out);
+
+	/**
+	 * @brief 标量实现，也用于处理向量实现剩下的尾部
+	 * @param offset 输出的位置需要加上的偏移
+	 */
+	size_type DoScanScalar(const char* data, size_type size, char delimiter, position_type* out, size_type offset) {
+		size_type count = 0;
+		for (size_type i = 0; i < size; ++i) {
+			if (data[i] == delimiter || data[i] == work::DelimiterScanner::newline) {
+				out[count++] = static_cast<position_type>(offset + i);
+			}
+		}
+		return count;
+	}
+
+	size_type ScanScalar(const char* data, size_type size, char delimiter, position_type* out) {
+		return DoScanScalar(data, size, delimiter, out, 0);
+	}
+
+#if WORK_SCANNER_X86
+	/**
+	 * @brief 将比较得到的掩码转为位置
+	 */
+	template<typename Mask>
+	inline size_type DoExtractPositions(Mask mask, size_type offset, position_type* out) {
+		size_type count = 0;
+		while (mask) {
+			out[count++] = static_cast<position_type>(offset + static_cast<size_type>(__builtin_ctzll(mask)));
+			mask &= mask - 1;
+		}
+		return count;
+	}
+
+	/**
+	 * @brief SSE2实现，也用于处理AVX2实现剩下的尾部
+	 * @param offset 输出的位置需要加上的偏移
+	 */
+	__attribute__((target("sse2"))) size_type DoScanSse2(const char* data, size_type size, char delimiter, position_type* out, size_type offset) {
+		const auto d		 = _mm_set1_epi8(delimiter);
+		const auto n		 = _mm_set1_epi8(work::DelimiterScanner::newline);
+
+		size_type	 count = 0;
+		size_type	 i		 = 0;
+		for (; i + 16 <= size; i += 16) {
+			auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			auto mask	 = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, d), _mm_cmpeq_epi8(chunk, n))));
+			count += DoExtractPositions(mask, offset + i, out + count);
+		}
+		return count + DoScanScalar(data + i, size - i, delimiter, out + count, offset + i);
+	}
+
+	size_type ScanSse2(const char* data, size_type size, char delimiter, position_type* out) {
+		return DoScanSse2(data, size, delimiter, out, 0);
+	}
+
+	__attribute__((target("avx2"))) size_type ScanAvx2(const char* data, size_type size, char delimiter, position_type* out) {
+		const auto d		 = _mm256_set1_epi8(delimiter);
+		const auto n		 = _mm256_set1_epi8(work::DelimiterScanner::newline);
+
+		size_type	 count = 0;
+		size_type	 i		 = 0;
+		// 每次处理64字节，合并为一个64位掩码
+		for (; i + 64 <= size; i += 64) {
+			auto lo				= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+			auto hi				= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+			auto lo_mask	= static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(lo, d), _mm256_cmpeq_epi8(lo, n))));
+			auto hi_mask	= static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(hi, d), _mm256_cmpeq_epi8(hi, n))));
+			uint64_t mask = (static_cast<uint64_t>(hi_mask) << 32) | lo_mask;
+			count += DoExtractPositions(mask, i, out + count);
+		}
+		return count + DoScanSse2(data + i, size - i, delimiter, out + count, i);
+	}
+#endif
+
+	struct ScanImplementation {
+		scan_function_type function;
+		const char*				 name;
+	};
+
+	/**
+	 * @brief 根据cpu特性选择实现，只在第一次调用时检测
+	 * @return 选择的实现
+	 */
+	const ScanImplementation& DoGetImplementation() {
+		static const ScanImplementation implementation = []() -> ScanImplementation {
+#if WORK_SCANNER_X86
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2")) {
+				return {&ScanAvx2, "avx2"};
+			}
+			if (__builtin_cpu_supports("sse2")) {
+				return {&ScanSse2, "sse2"};
+			}
+#endif
+			return {&ScanScalar, "scalar"};
+		}();
+		return implementation;
+	}
+}// namespace
+
+namespace work {
+	DelimiterScanner::DelimiterScanner(char delimiter)
+		: delimiter_(delimiter),
+			capacity_(0) {}
+
+	DelimiterScanner::size_type DelimiterScanner::Scan(StringSpan buffer) {
+		if (buffer.size() > capacity_) {
+			capacity_	 = buffer.size() > recommended_size ? buffer.size() : recommended_size;
+			positions_ = std::unique_ptr<position_type[]>(new position_type[capacity_]);
+		}
+		return DoGetImplementation().function(buffer.data(), buffer.size(), delimiter_, positions_.get());
+	}
+
+	const char* DelimiterScanner::GetImplementationName() {
+		return DoGetImplementation().name;
+	}
+}// namespace work
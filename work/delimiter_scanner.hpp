@@ -0,0 +1,63 @@
+#ifndef DELIMITER_SCANNER_HPP
+#define DELIMITER_SCANNER_HPP
+
+#include <cstdint>
+#include <memory>
+
+#include "string_span.hpp"
+
+namespace work {
+	/**
+	 * @brief 一次扫描找出一段缓冲区中所有分隔符以及换行符的位置
+	 * 根据运行时的cpu特性选择AVX2/SSE2/标量实现
+	 */
+	class DelimiterScanner {
+	public:
+		using size_type															 = StringSpan::size_type;
+		/**
+		 * @brief 位置相对于缓冲区开头，所以一次扫描的缓冲区不能超过4G
+		 */
+		using position_type													 = uint32_t;
+
+		constexpr static char			 newline					 = '\n';
+		/**
+		 * @brief 建议的单次扫描的大小，保证位置数组能留在缓存中
+		 */
+		constexpr static size_type recommended_size = 1 << 20;
+
+		/**
+		 * @brief 构造扫描器
+		 * @param delimiter 分隔符
+		 */
+		explicit DelimiterScanner(char delimiter);
+
+		/**
+		 * @brief 扫描缓冲区，结果通过GetPositions获取，在下一次扫描之前有效
+		 * @param buffer 要扫描的缓冲区
+		 * @return 找到的分隔符以及换行符的个数
+		 */
+		size_type									 Scan(StringSpan buffer);
+
+		/**
+		 * @brief 获取上一次扫描的结果(升序)
+		 * @return 所有位置
+		 */
+		const position_type*			 GetPositions() const { return positions_.get(); }
+
+		/**
+		 * @brief 获取当前cpu所使用的实现的名字
+		 * @return 实现的名字
+		 */
+		static const char*				 GetImplementationName();
+
+	private:
+		// 分隔符
+		char														 delimiter_;
+		// 位置数组，最坏情况下每个字节都是分隔符，所以容量不小于缓冲区的大小
+		std::unique_ptr<position_type[]> positions_;
+		// 位置数组的容量
+		size_type												 capacity_;
+	};
+}// namespace work
+
+#endif//DELIMITER_SCANNER_HPP
@@ -1,97 +1,815 @@
 #include "dir_watchdog.hpp"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#include <boost/thread/v2/thread.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
 
 #include "error_logger.hpp"
 
+namespace {
+	/**
+	 * @brief 递归监控时额外需要的事件，用于发现新建、移入以及移出的子目录，这些事件不会分发给回调函数
+	 */
+	constexpr uint32_t recursive_mask = IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM;
+
+	/**
+	 * @brief 扫描时需要检查所有已有文件的事件，只关心新文件时目录没有变化就不需要检查文件
+	 */
+	constexpr uint32_t content_mask		= IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB;
+
+	int64_t DoToNanoseconds(const timespec& time) {
+		return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+	}
+
+	int64_t DoGetRealtime() {
+		timespec now{};
+		clock_gettime(CLOCK_REALTIME, &now);
+		return DoToNanoseconds(now);
+	}
+}// namespace
+
 namespace work {
-	bool DirWatchdog::AddPath(const std::string& path) {
-		// 获取一个新的fd
-		auto fd = inotify_init();
-		if (fd < 0) {
-			LOG2FILE(LOG_LEVEL::ERROR, "inotify_init failed: " + path);
+	DirWatchdog::DirWatchdog()
+		: read_buffer_(new char[read_buffer_size]),
+			inotify_fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+			epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+			stop_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+		if (epoll_fd_ < 0 || stop_fd_ < 0) {
+			LOG2FILE(LOG_LEVEL::ERROR, std::string{"Cannot create watchdog: "} + std::strerror(errno));
+			return;
+		}
+
+		epoll_event event{};
+		event.events = EPOLLIN;
+		if (inotify_fd_ < 0) {
+			// 依然可以使用BACKEND::POLL
+			LOG2FILE(LOG_LEVEL::ERROR, std::string{"inotify not available, only polling is supported: "} + std::strerror(errno));
+		} else {
+			event.data.fd = inotify_fd_;
+			if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, inotify_fd_, &event) < 0) {
+				LOG2FILE(LOG_LEVEL::ERROR, std::string{"epoll_ctl failed: "} + std::strerror(errno));
+			}
+		}
+		event.data.fd = stop_fd_;
+		if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_fd_, &event) < 0) {
+			LOG2FILE(LOG_LEVEL::ERROR, std::string{"epoll_ctl failed: "} + std::strerror(errno));
+		}
+	}
+
+	DirWatchdog::~DirWatchdog() {
+		for (auto fd: {inotify_fd_, epoll_fd_, stop_fd_}) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+	}
+
+	bool DirWatchdog::AddPath(const std::string& path, bool recursive, BACKEND backend) {
+		if (backend == BACKEND::INOTIFY && inotify_fd_ < 0) {
+			LOG2FILE(LOG_LEVEL::ERROR, "inotify not available: " + path);
 			return false;
 		}
 
-		return path_fd_.emplace(path, fd).second;
+		Entry entry;
+		entry.path			= path;
+		entry.recursive = recursive;
+		if (backend == BACKEND::POLL) {
+			entry.poll.reset(new PollState);
+		}
+		return path_entry_.emplace(path, std::move(entry)).second;
 	}
 
-	int DirWatchdog::GetPathFd(const std::string& path) {
-		auto it = path_fd_.find(path);
-		if (it == path_fd_.end()) {
+	int DirWatchdog::GetPathWd(const std::string& path) {
+		auto it = path_entry_.find(path);
+		if (it == path_entry_.end()) {
 			LOG2FILE(LOG_LEVEL::ERROR, "Path not added yet: " + path);
 			return path_not_added_code;
 		}
 
-		return it->second;
+		return it->second.wd;
 	}
 
 	bool DirWatchdog::SetWatch(const std::string& path, EVENT_TYPE event, bool overwrite) {
-		auto fd = GetPathFd(path);
-		if (fd == path_not_added_code) {
+		auto it = path_entry_.find(path);
+		if (it == path_entry_.end()) {
+			LOG2FILE(LOG_LEVEL::ERROR, "Path not added yet: " + path);
 			return false;
 		}
+		auto&									entry = it->second;
 
 		event_underlying_type curr_mask;
 		if (overwrite) {
 			curr_mask = event;
 		} else {
-			curr_mask = fd_mask_[fd] | event;
+			curr_mask = entry.mask | event;
 		}
 
-		// 对fd添加一个wd
-		auto wd = inotify_add_watch(fd, path.c_str(), curr_mask);
+		if (entry.poll) {
+			entry.mask = curr_mask;
+			if (entry.wd != path_not_added_code) {
+				return true;
+			}
+
+			struct stat st {};
+			if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+				LOG2FILE(LOG_LEVEL::ERROR, "Cannot poll path: " + path);
+				return false;
+			}
+			// 已有的文件由调用者自己处理，这里只建立快照
+			entry.wd							= next_poll_id_--;
+			entry.poll->interval	= poll_min_interval_;
+			entry.poll->next			= std::chrono::steady_clock::now() + poll_min_interval_;
+			bool changed					= false;
+			return DoPollEntry(entry, true, changed);
+		}
+
+		// 对同一个inotify实例添加一个wd，同一个目录再次添加时得到的是同一个wd
+		auto wd = inotify_add_watch(inotify_fd_, path.c_str(), curr_mask | (entry.recursive ? recursive_mask : 0));
 		if (wd < 0) {
 			LOG2FILE(LOG_LEVEL::ERROR, "inotify_add_watch failed: " + path);
 			return false;
 		}
 
-		fd_wd_[fd]	 = wd;
-		fd_mask_[fd] = curr_mask;
-		return true;
+		auto wd_it = watches_.find(wd);
+		if (wd_it != watches_.end() && wd_it->second.entry != &entry) {
+			// 两个路径指向同一个目录(例如符号链接)，事件只会分发给后添加的路径
+			LOG2FILE(LOG_LEVEL::WARNING, "Path " + path + " is the same directory as " + wd_it->second.entry->path);
+		}
+
+		entry.wd	 = wd;
+		entry.mask = curr_mask;
+		DoLinkWatch(wd, entry, path_not_added_code, "");
+
+		// 已有的文件由调用者自己处理，这里只为已有的子目录添加监控
+		return !entry.recursive || DoScanDirectory(entry, wd, false);
 	}
 
 	bool DirWatchdog::SetCallback(const std::string& path, const callback_type& callback, bool overwrite) {
-		auto fd = GetPathFd(path);
-		if (fd == path_not_added_code) {
+		auto it = path_entry_.find(path);
+		if (it == path_entry_.end()) {
+			LOG2FILE(LOG_LEVEL::ERROR, "Path not added yet: " + path);
 			return false;
 		}
 
-		if (fd_callback_.find(fd) == fd_callback_.end() || overwrite) {
-			return fd_callback_.emplace(fd, callback).second;
+		if (!it->second.callback || overwrite) {
+			it->second.callback = std::make_shared<const callback_type>(callback);
+			return true;
 		}
 		return false;
 	}
 
-	void DirWatchdog::Run(const std::string& path) {
-		auto fd = GetPathFd(path);
-		if (fd == path_not_added_code) {
+	void DirWatchdog::Run() {
+		if (epoll_fd_ < 0) {
 			return;
 		}
 
-		auto&		callback = fd_callback_[fd];
+		constexpr static int max_events = 2;
+		epoll_event					 events[max_events];
+		for (;;) {
+			// 扫描发现的变化也可能需要合并，所以先扫描
+			auto poll_timeout = DoPoll();
+			// 有等待合并的事件时只等到最近的截止时间
+			auto timeout			= DoFlushCoalescing();
+			if (poll_timeout >= 0 && (timeout < 0 || poll_timeout < timeout)) {
+				timeout = poll_timeout;
+			}
+			auto count	 = epoll_wait(epoll_fd_, events, max_events, timeout);
+			if (count < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				LOG2FILE(LOG_LEVEL::ERROR, std::string{"epoll_wait failed: "} + std::strerror(errno));
+				return;
+			}
+
+			for (int i = 0; i < count; ++i) {
+				if (events[i].data.fd == stop_fd_) {
+					return;
+				}
+				if (!DoReadEvents()) {
+					return;
+				}
+			}
+		}
+	}
+
+	void DirWatchdog::SetQuietWindow(std::chrono::milliseconds quiet_window) {
+		quiet_window_ = quiet_window;
+	}
+
+	void DirWatchdog::SetPollInterval(std::chrono::milliseconds min_interval, std::chrono::milliseconds max_interval) {
+		poll_min_interval_ = std::max(min_interval, std::chrono::milliseconds(1));
+		poll_max_interval_ = std::max(max_interval, poll_min_interval_);
+	}
+
+	void DirWatchdog::Dispatch() {
+		PendingEvent event;
+		while (dispatch_queue_.Pop(event)) {
+			auto latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - event.time).count());
+			dispatched_.fetch_add(1, std::memory_order_relaxed);
+			window_dispatched_.fetch_add(1, std::memory_order_relaxed);
+			total_latency_.fetch_add(latency, std::memory_order_relaxed);
+			auto max = max_latency_.load(std::memory_order_relaxed);
+			while (latency > max && !max_latency_.compare_exchange_weak(max, latency, std::memory_order_relaxed)) {
+			}
+
+			(*event.callback)(event.mask, event.name);
+		}
+	}
+
+	void DirWatchdog::Stop() {
+		uint64_t one = 1;
+		if (write(stop_fd_, &one, sizeof(one)) < 0) {
+			LOG2FILE(LOG_LEVEL::ERROR, std::string{"Cannot stop watchdog: "} + std::strerror(errno));
+		}
+		// 已经放入队列的事件依然会被分发
+		dispatch_queue_.Close();
+	}
+
+	DirWatchdog::DispatchMetrics DirWatchdog::GetDispatchMetrics(bool reset) {
+		DispatchMetrics ret{};
+		ret.queue			 = dispatch_queue_.GetMetrics(reset);
+		ret.dispatched = dispatched_.load(std::memory_order_relaxed);
+		ret.coalesced	 = coalesced_.load(std::memory_order_relaxed);
+		ret.events		 = events_.load(std::memory_order_relaxed);
+		ret.overflows	 = overflows_.load(std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(metrics_mutex_);
+			auto												now			= std::chrono::steady_clock::now();
+			auto												seconds = std::chrono::duration<double>(now - window_start_).count();
+			auto												events	= reset ? window_events_.exchange(0, std::memory_order_relaxed) : window_events_.load(std::memory_order_relaxed);
+			if (seconds > 0) {
+				ret.event_rate = static_cast<double>(events) / seconds;
+			}
+			if (reset) {
+				window_start_ = now;
+			}
+		}
+
+		auto count		 = reset ? window_dispatched_.exchange(0, std::memory_order_relaxed) : window_dispatched_.load(std::memory_order_relaxed);
+		auto total		 = reset ? total_latency_.exchange(0, std::memory_order_relaxed) : total_latency_.load(std::memory_order_relaxed);
+		auto max			 = reset ? max_latency_.exchange(0, std::memory_order_relaxed) : max_latency_.load(std::memory_order_relaxed);
+		if (count > 0) {
+			ret.average_latency = static_cast<double>(total) / static_cast<double>(count) / 1000;
+		}
+		ret.max_latency = static_cast<double>(max) / 1000;
+		return ret;
+	}
+
+	bool DirWatchdog::DoReadEvents() {
+		auto* buffer = read_buffer_.get();
+		for (;;) {
+			auto length = read(inotify_fd_, buffer, read_buffer_size);
+			if (length < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				// 非阻塞的fd，已经读完所有就绪的事件
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					// 同一次rename的两个事件一起入队，没有配对的目录已经移出了树
+					for (const auto& cookie_wd: moved_from_) {
+						DoRemoveSubtree(cookie_wd.second);
+					}
+					moved_from_.clear();
+					return true;
+				}
+				LOG2FILE(LOG_LEVEL::ERROR, std::string{"Cannot read inotify events: "} + std::strerror(errno));
+				return false;
+			}
+			if (length == 0) {
+				return false;
+			}
 
-		char		buffer[BUFSIZ]{};
-		ssize_t length;
-		// 轮询fd，经测试只有在wd被触发时read才会生效
-		while ((length = read(fd, buffer, sizeof(buffer) - 1)) > 0) {
 			ssize_t curr = 0;
-			while (length > 0) {
+			while (curr < length) {
 				auto* event = reinterpret_cast<inotify_event*>(buffer + curr);
+				curr += static_cast<ssize_t>(sizeof(inotify_event)) + event->len;
+				events_.fetch_add(1, std::memory_order_relaxed);
+				window_events_.fetch_add(1, std::memory_order_relaxed);
+
+				if (event->mask & IN_Q_OVERFLOW) {
+					// 溢出的事件不属于任何wd，无法知道哪些目录丢失了事件，所以让所有路径重新扫描
+					overflows_.fetch_add(1, std::memory_order_relaxed);
+					LOG2FILE(LOG_LEVEL::ERROR, "inotify event queue overflow, rescan all paths");
+					for (auto& path_entry: path_entry_) {
+						auto& entry = path_entry.second;
+						// 扫描的路径不使用inotify
+						if (entry.wd == path_not_added_code || entry.poll) {
+							continue;
+						}
+						// 丢失的事件中可能有新建的子目录
+						if (entry.recursive && !DoScanDirectory(entry, entry.wd, false)) {
+							return false;
+						}
+						if (entry.callback && !DoEnqueue(entry.wd, entry, IN_Q_OVERFLOW, "")) {
+							return false;
+						}
+					}
+					continue;
+				}
 
-				if (callback) {
-					callback(event->mask, event->name);
-					LOG2FILE(LOG_LEVEL::INFO, "Mask: " + std::to_string(event->mask) + " Name: " + event->name);
+				auto it = watches_.find(event->wd);
+				if (it == watches_.end()) {
+					continue;
+				}
+
+				if (event->mask & IN_IGNORED) {
+					// 目录被删除或者监控被移除
+					if (it->second.parent == path_not_added_code) {
+						LOG2FILE(LOG_LEVEL::WARNING, "Watch removed: " + it->second.entry->path);
+						it->second.entry->wd = path_not_added_code;
+					}
+					DoUnlinkWatch(it->first, it->second);
+					watches_.erase(it);
+					continue;
+				}
+
+				auto&				entry = *it->second.entry;
+				std::string name	= event->len > 0 ? event->name : "";
+				if (entry.recursive && (event->mask & IN_ISDIR)) {
+					if (!DoHandleDirEvent(event->wd, it->second, event->mask, event->cookie, name)) {
+						return false;
+					}
+					continue;
+				}
+				// 只有递归监控需要的事件
+				if ((event->mask & entry.mask) == 0) {
+					continue;
+				}
+
+				if (entry.callback) {
+					LOG2FILE(LOG_LEVEL::INFO, "Mask: " + std::to_string(event->mask) + " Name: " + name);
+					// 回调函数在分发线程中执行，这里只放入队列，队列满时等待
+					if (!DoEnqueue(event->wd, entry, event->mask, DoGetRelativePath(event->wd, name))) {
+						// 已经停止
+						return false;
+					}
 				} else {
-					LOG2FILE(LOG_LEVEL::WARNING, "Callback not valid of fd: " + std::to_string(fd));
+					LOG2FILE(LOG_LEVEL::WARNING, "Callback not valid of path: " + entry.path);
 				}
+			}
+		}
+	}
 
-				curr += static_cast<ssize_t>(sizeof(inotify_event)) + event->len;
-				length -= static_cast<ssize_t>(sizeof(inotify_event)) + event->len;
+	bool DirWatchdog::DoHandleDirEvent(int wd, const Watch& watch, event_underlying_type mask, uint32_t cookie, const std::string& name) {
+		auto& entry = *watch.entry;
+		if (mask & IN_MOVED_FROM) {
+			// 目录被移出或者在树中被移动，等待同一个cookie的IN_MOVED_TO
+			auto it = watch.children.find(name);
+			if (it != watch.children.end()) {
+				auto child = it->second;
+				DoUnlinkWatch(child, watches_[child]);
+				moved_from_[cookie] = child;
 			}
 		}
+		if (mask & IN_MOVED_TO) {
+			auto it = moved_from_.find(cookie);
+			if (it != moved_from_.end()) {
+				auto child = it->second;
+				moved_from_.erase(it);
+				auto child_it = watches_.find(child);
+				if (child_it != watches_.end() && child_it->second.entry == &entry) {
+					// wd跟随目录移动，只需要更新位置，子树中的文件已经处理过
+					DoLinkWatch(child, entry, wd, name);
+					return true;
+				}
+				// 移动到了另一个被监控的路径中，对那个路径来说是新的目录
+				DoRemoveSubtree(child);
+			}
+		}
+		if (mask & (IN_CREATE | IN_MOVED_TO)) {
+			// 新建或者从树外移入的目录，添加监控之前目录中可能已经有文件，所以需要扫描一次
+			return DoAddSubtree(entry, wd, name, true);
+		}
+		return true;
+	}
+
+	bool DirWatchdog::DoAddSubtree(Entry& entry, int parent, const std::string& name, bool report_files) {
+		auto path = entry.path + "/" + DoGetRelativePath(parent, name);
+		auto wd		= inotify_add_watch(inotify_fd_, path.c_str(), entry.mask | recursive_mask | IN_ONLYDIR);
+		if (wd < 0) {
+			if (errno == ENOSPC) {
+				LOG2FILE(LOG_LEVEL::ERROR, "Too many watches, increase /proc/sys/fs/inotify/max_user_watches: " + path);
+			} else if (errno != ENOENT && errno != ENOTDIR) {
+				// 目录已经被删除或者移走时直接忽略
+				LOG2FILE(LOG_LEVEL::ERROR, "inotify_add_watch failed: " + path + " (" + std::strerror(errno) + ")");
+			}
+			return true;
+		}
+
+		// 同一个目录再次添加(例如在树中被移动)时得到的是同一个wd，更新它的位置
+		DoLinkWatch(wd, entry, parent, name);
+		return DoScanDirectory(entry, wd, report_files);
+	}
+
+	bool DirWatchdog::DoScanDirectory(Entry& entry, int wd, bool report_files) {
+		auto relative = DoGetRelativePath(wd, "");
+		auto path			= relative.empty() ? entry.path : entry.path + "/" + relative;
+		auto dir			= opendir(path.c_str());
+		if (!dir) {
+			return true;
+		}
+
+		// 先读取所有的名字再递归，避免在很深的目录树中同时打开太多的目录
+		std::vector<std::string> dirs;
+		std::vector<std::string> files;
+		while (auto* item = readdir(dir)) {
+			if (std::strcmp(item->d_name, ".") == 0 || std::strcmp(item->d_name, "..") == 0) {
+				continue;
+			}
+
+			bool is_dir = item->d_type == DT_DIR;
+			if (item->d_type == DT_UNKNOWN) {
+				struct stat st {};
+				is_dir = fstatat(dirfd(dir), item->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+			}
+
+			if (is_dir) {
+				dirs.emplace_back(item->d_name);
+			} else if (report_files) {
+				files.emplace_back(item->d_name);
+			}
+		}
+		closedir(dir);
+
+		// 已有的文件当作刚刚移入或者写入完成
+		auto mask = (entry.mask & (IN_MOVED_TO | IN_CLOSE_WRITE | IN_CREATE)) | IN_SCANNED;
+		for (const auto& file: files) {
+			if (entry.callback && !DoEnqueue(wd, entry, mask, DoGetRelativePath(wd, file))) {
+				return false;
+			}
+		}
+		for (const auto& name: dirs) {
+			if (!DoAddSubtree(entry, wd, name, report_files)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void DirWatchdog::DoLinkWatch(int wd, Entry& entry, int parent, const std::string& name) {
+		// 已有的wd保留子目录索引，子目录的parent仍然指向它
+		auto& watch = watches_[wd];
+		DoUnlinkWatch(wd, watch);
+		watch.entry	 = &entry;
+		watch.parent = parent;
+		watch.name	 = name;
+		if (parent != path_not_added_code) {
+			auto parent_it = watches_.find(parent);
+			if (parent_it != watches_.end()) {
+				parent_it->second.children[name] = wd;
+			}
+		}
+	}
+
+	void DirWatchdog::DoUnlinkWatch(int wd, const Watch& watch) {
+		if (watch.parent == path_not_added_code) {
+			return;
+		}
+		auto parent_it = watches_.find(watch.parent);
+		if (parent_it == watches_.end()) {
+			return;
+		}
+		auto& children = parent_it->second.children;
+		auto	it			 = children.find(watch.name);
+		if (it != children.end() && it->second == wd) {
+			children.erase(it);
+		}
+	}
+
+	void DirWatchdog::DoRemoveSubtree(int wd) {
+		auto it = watches_.find(wd);
+		if (it == watches_.end()) {
+			return;
+		}
+		DoUnlinkWatch(wd, it->second);
+
+		// 只沿着子目录索引遍历子树
+		std::vector<int> pending{wd};
+		while (!pending.empty()) {
+			auto child = pending.back();
+			pending.pop_back();
+			it = watches_.find(child);
+			if (it == watches_.end()) {
+				continue;
+			}
+			for (const auto& name_wd: it->second.children) {
+				pending.push_back(name_wd.second);
+			}
+			// 之后收到的IN_IGNORED会因为找不到wd而被忽略
+			inotify_rm_watch(inotify_fd_, child);
+			watches_.erase(it);
+		}
+	}
+
+	std::string DirWatchdog::DoGetRelativePath(int wd, const std::string& name) const {
+		std::vector<const std::string*> parts;
+		if (!name.empty()) {
+			parts.push_back(&name);
+		}
+		for (auto it = watches_.find(wd); it != watches_.end() && it->second.parent != path_not_added_code; it = watches_.find(it->second.parent)) {
+			parts.push_back(&it->second.name);
+		}
+
+		std::string ret;
+		for (auto it = parts.rbegin(); it != parts.rend(); ++it) {
+			if (!ret.empty()) {
+				ret += '/';
+			}
+			ret += **it;
+		}
+		return ret;
+	}
+
+	bool DirWatchdog::DoEnqueue(int wd, const Entry& entry, event_underlying_type mask, std::string name) {
+		auto now = std::chrono::steady_clock::now();
+		if (quiet_window_.count() <= 0) {
+			return dispatch_queue_.Push({entry.callback, mask, std::move(name), now});
+		}
+
+		coalesce_key_type key{wd, std::move(name)};
+		auto							it = coalescing_.find(key);
+		if (it == coalescing_.end()) {
+			auto deadline = now + quiet_window_;
+			deadline_.emplace(deadline, key);
+			coalescing_.emplace(std::move(key), CoalescingEvent{entry.callback, mask, now, deadline});
+			return true;
+		}
+
+		// 合并到已有的事件中，并推迟截止时间
+		auto& pending = it->second;
+		pending.mask |= mask;
+		auto deadline = std::min(now + quiet_window_, pending.first + quiet_window_ * static_cast<int>(max_coalesce_multiple));
+		if (deadline != pending.deadline) {
+			pending.deadline = deadline;
+			deadline_.emplace(deadline, it->first);
+		}
+		coalesced_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	int DirWatchdog::DoFlushCoalescing() {
+		auto now = std::chrono::steady_clock::now();
+		while (!deadline_.empty()) {
+			auto top = deadline_.begin();
+			if (top->first > now) {
+				// 向上取整，避免在截止时间之前醒来
+				auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(top->first - now).count() + 1;
+				return static_cast<int>(wait);
+			}
+
+			auto it = coalescing_.find(top->second);
+			// 截止时间被推迟过的旧项直接跳过
+			if (it != coalescing_.end() && it->second.deadline == top->first) {
+				if (!dispatch_queue_.Push({std::move(it->second.callback), it->second.mask, it->first.second, now})) {
+					return -1;
+				}
+				coalescing_.erase(it);
+			}
+			deadline_.erase(top);
+		}
+		return -1;
+	}
+
+	int DirWatchdog::DoPoll() {
+		int timeout = -1;
+		for (auto& path_entry: path_entry_) {
+			auto& entry = path_entry.second;
+			if (!entry.poll || entry.wd == path_not_added_code) {
+				continue;
+			}
+
+			auto& state = *entry.poll;
+			auto	now		= std::chrono::steady_clock::now();
+			if (state.next <= now) {
+				bool changed = false;
+				if (!DoPollEntry(entry, false, changed)) {
+					return -1;
+				}
+				// 有变化时很可能还会继续变化，使用最短间隔，否则逐渐延长
+				state.interval = changed ? poll_min_interval_ : std::min(state.interval * 2, poll_max_interval_);
+				now						 = std::chrono::steady_clock::now();
+				state.next		 = now + state.interval;
+			}
+
+			auto wait = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(state.next - now).count()) + 1;
+			if (timeout < 0 || wait < timeout) {
+				timeout = wait;
+			}
+		}
+		return timeout;
+	}
+
+	bool DirWatchdog::DoPollEntry(Entry& entry, bool baseline, bool& changed) {
+		auto& state = *entry.poll;
+
+		struct stat st {};
+		bool				available = stat(entry.path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+		if (available != state.available) {
+			state.available = available;
+			LOG2FILE(available ? LOG_LEVEL::WARNING : LOG_LEVEL::ERROR, std::string{available ? "Path available again: " : "Cannot poll path: "} + entry.path);
+		}
+		if (!available) {
+			// 保留快照，恢复之后只分发期间的变化
+			return true;
+		}
+
+		std::vector<std::string> pending{""};
+		std::vector<std::string> dirs;
+		while (!pending.empty()) {
+			auto relative = std::move(pending.back());
+			pending.pop_back();
+
+			dirs.clear();
+			if (!DoPollDirectory(entry, relative, baseline, changed, dirs)) {
+				return false;
+			}
+			for (auto& dir: dirs) {
+				pending.push_back(std::move(dir));
+			}
+		}
+		return true;
+	}
+
+	bool DirWatchdog::DoPollDirectory(Entry& entry, const std::string& relative, bool baseline, bool& changed, std::vector<std::string>& dirs) {
+		auto& state = *entry.poll;
+		auto	path	= relative.empty() ? entry.path : entry.path + "/" + relative;
+		auto	child = [&relative](const std::string& name) {
+			 return relative.empty() ? name : relative + "/" + name;
+		};
+		// 子目录被删除时移除整个子树的快照，'0'是'/'的下一个字符
+		auto remove_subtree = [&state](const std::string& dir) {
+			state.dirs.erase(state.dirs.lower_bound(dir + "/"), state.dirs.lower_bound(dir + "0"));
+			state.dirs.erase(dir);
+		};
+
+		auto& snapshot = state.dirs[relative];
+		struct stat dir_st {};
+		if (stat(path.c_str(), &dir_st) != 0 || !S_ISDIR(dir_st.st_mode)) {
+			if (!relative.empty()) {
+				remove_subtree(relative);
+			}
+			return true;
+		}
+
+		auto mtime = DoToNanoseconds(dir_st.st_mtim);
+		// 目录没有变化时名字不会变化，但是修改时间精度不够时无法确定
+		bool list	 = baseline || snapshot.inode != dir_st.st_ino || snapshot.mtime != mtime || mtime + poll_racy_window >= snapshot.listed_at;
+		bool check = (entry.mask & content_mask) != 0 || snapshot.unstable > 0;
+		if (!list && !check) {
+			for (const auto& name: snapshot.dirs) {
+				dirs.push_back(child(name));
+			}
+			return true;
+		}
+
+		auto dir = opendir(path.c_str());
+		if (!dir) {
+			return true;
+		}
+
+		std::vector<std::pair<std::string, event_underlying_type>> events;
+		// 与快照比较一个文件，返回需要分发的事件
+		auto diff = [&](PollFile& file, const struct stat& st) -> event_underlying_type {
+			auto inode = static_cast<uint64_t>(st.st_ino);
+			auto size	 = static_cast<uint64_t>(st.st_size);
+			auto time	 = DoToNanoseconds(st.st_mtim);
+			if (file.inode != inode) {
+				file = PollFile{inode, size, time, false};
+				return IN_CREATE;
+			}
+			if (file.size != size || file.mtime != time) {
+				file.size		= size;
+				file.mtime	= time;
+				file.stable = false;
+				return IN_MODIFY;
+			}
+			if (!file.stable) {
+				// 上一次扫描之后没有再变化，当作写入完成
+				file.stable = true;
+				return IN_CLOSE_WRITE | IN_MOVED_TO;
+			}
+			return 0;
+		};
+
+		if (list) {
+			snapshot.inode		 = dir_st.st_ino;
+			snapshot.mtime		 = mtime;
+			snapshot.listed_at = DoGetRealtime();
+
+			std::unordered_map<std::string, PollFile> files;
+			std::vector<std::string>									sub_dirs;
+			while (auto* item = readdir(dir)) {
+				if (std::strcmp(item->d_name, ".") == 0 || std::strcmp(item->d_name, "..") == 0) {
+					continue;
+				}
+
+				bool is_dir = item->d_type == DT_DIR;
+				if (item->d_type == DT_UNKNOWN || item->d_type == DT_LNK || item->d_type == DT_REG) {
+					struct stat st {};
+					if (fstatat(dirfd(dir), item->d_name, &st, 0) != 0) {
+						continue;
+					}
+					// 符号链接指向的目录不递归
+					is_dir = S_ISDIR(st.st_mode) && item->d_type == DT_UNKNOWN;
+					if (!is_dir) {
+						if (!S_ISREG(st.st_mode)) {
+							continue;
+						}
+
+						std::string name{item->d_name};
+						auto				it = snapshot.files.find(name);
+						if (it == snapshot.files.end()) {
+							// 建立快照时已有的文件当作已经写入完成
+							files.emplace(name, PollFile{static_cast<uint64_t>(st.st_ino), static_cast<uint64_t>(st.st_size), DoToNanoseconds(st.st_mtim), baseline});
+							if (!baseline) {
+								events.emplace_back(std::move(name), IN_CREATE);
+							}
+						} else {
+							auto mask = diff(it->second, st);
+							files.emplace(name, it->second);
+							snapshot.files.erase(it);
+							if (mask) {
+								events.emplace_back(std::move(name), mask);
+							}
+						}
+						continue;
+					}
+				}
+
+				if (is_dir && entry.recursive) {
+					sub_dirs.emplace_back(item->d_name);
+				}
+			}
+
+			// 剩下的文件已经消失
+			for (auto& name_file: snapshot.files) {
+				events.emplace_back(name_file.first, IN_DELETE);
+			}
+			snapshot.files.swap(files);
+
+			// 移除消失的子目录，新的子目录在之后扫描，其中的文件都是新文件
+			std::sort(sub_dirs.begin(), sub_dirs.end());
+			for (const auto& name: snapshot.dirs) {
+				if (!std::binary_search(sub_dirs.begin(), sub_dirs.end(), name)) {
+					remove_subtree(child(name));
+				}
+			}
+			snapshot.dirs.swap(sub_dirs);
+		} else {
+			for (auto it = snapshot.files.begin(); it != snapshot.files.end();) {
+				if (it->second.stable && (entry.mask & content_mask) == 0) {
+					++it;
+					continue;
+				}
+
+				struct stat st {};
+				if (fstatat(dirfd(dir), it->first.c_str(), &st, 0) != 0) {
+					events.emplace_back(it->first, IN_DELETE);
+					it = snapshot.files.erase(it);
+					continue;
+				}
+				auto mask = diff(it->second, st);
+				if (mask) {
+					events.emplace_back(it->first, mask);
+				}
+				++it;
+			}
+		}
+		closedir(dir);
+
+		snapshot.unstable = 0;
+		for (const auto& name_file: snapshot.files) {
+			if (!name_file.second.stable) {
+				++snapshot.unstable;
+			}
+		}
+		for (const auto& name: snapshot.dirs) {
+			dirs.push_back(child(name));
+		}
+
+		if (!events.empty()) {
+			changed = true;
+		}
+		for (auto& name_event: events) {
+			events_.fetch_add(1, std::memory_order_relaxed);
+			window_events_.fetch_add(1, std::memory_order_relaxed);
+			if ((name_event.second & entry.mask) == 0 || !entry.callback) {
+				continue;
+			}
+			if (!DoEnqueue(entry.wd, entry, name_event.second, child(name_event.first))) {
+				return false;
+			}
+		}
+		return true;
 	}
 }// namespace work
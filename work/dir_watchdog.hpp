@@ -1,11 +1,18 @@
 #ifndef DIR_WATCHDOG_HPP
 #define DIR_WATCHDOG_HPP
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "bounded_queue.hpp"
+
 namespace work {
 	class DirWatchdog {
 	public:
@@ -41,6 +48,15 @@ namespace work {
 			IN_DELETE_SELF		= 0x00000400,
 			// 自身被移动(改名)
 			IN_MOVE_SELF			= 0x00000800,
+			// 事件队列溢出，有事件丢失，Run会对每个路径分发一个只带有这个代码(文件名为空)的事件，用于重新扫描目录
+			IN_Q_OVERFLOW			= 0x00004000,
+			// 监控被移除(目录被删除或者被显式移除)
+			IN_IGNORED				= 0x00008000,
+			// 事件的对象是目录
+			IN_ISDIR					= 0x40000000,
+			// watchdog自己的标记(inotify中这一位只用于设置监控)：事件不是inotify产生的，而是递归监控新目录时扫描目录发现的已有文件
+			// 文件可能在事件之前已经被处理过
+			IN_SCANNED				= 0x01000000,
 			// 所有事件
 			IN_ALL_EVENTS =
 					IN_ACCESS | IN_MODIFY | IN_ATTRIB |
@@ -50,28 +66,96 @@ namespace work {
 		};
 
 		/**
-		 * @brief 文件没有被映射的情况下获取到的fd
+		 * @brief 监控路径的方式
+		 */
+		enum class BACKEND {
+			// 使用inotify，事件由内核产生
+			INOTIFY,
+			// 定期扫描目录并与上一次的快照(名字、inode、大小、修改时间)比较，用于inotify不会产生事件的文件系统(NFS、FUSE等)
+			POLL
+		};
+
+		/**
+		 * @brief 路径没有被添加或者还没有设置监控时获取到的wd
 		 */
 		constexpr static int path_not_added_code = -1;
 
 		/**
 		 * @brief callback函数类型，参数为事件的代码以及文件的名字
+		 * 递归监控的路径中，子目录里的文件的名字是相对于被监控路径的路径，例如`sub/file`
 		 */
 		using callback_type											 = std::function<void(event_underlying_type, const std::string&)>;
 
+		/**
+		 * @brief 等待分发的事件的最大数量，队列满时监控线程等待
+		 */
+		constexpr static std::size_t dispatch_queue_capacity = 4096;
+
+		/**
+		 * @brief 合并事件时最长的等待时间是静默时间的多少倍，避免持续写入的文件一直得不到分发
+		 */
+		constexpr static int				 max_coalesce_multiple	 = 10;
+
+		/**
+		 * @brief 读取事件的缓冲区大小，一次系统调用可以读取数千个事件
+		 */
+		constexpr static std::size_t read_buffer_size				 = 1 << 18;
+
+		/**
+		 * @brief 目录的修改时间距离上一次读取目录不超过这个时间(纳秒)时依然读取目录
+		 * 部分文件系统的时间精度只有秒甚至两秒，同一个时间内的修改无法通过修改时间发现
+		 */
+		constexpr static int64_t		 poll_racy_window				 = 2000000000;
+
+		/**
+		 * @brief 分发的统计信息
+		 */
+		struct DispatchMetrics {
+			// 等待分发的事件队列
+			QueueMetrics queue;
+			// 分发的事件数
+			uint64_t		 dispatched;
+			// 被合并到其他事件中的事件数
+			uint64_t		 coalesced;
+			// 从inotify读取的事件数
+			uint64_t		 events;
+			// 上一次重置之后平均每秒读取的事件数
+			double			 event_rate;
+			// 事件队列溢出的次数
+			uint64_t		 overflows;
+			// 从读取事件到开始执行回调函数的平均延迟与最大延迟(微秒)
+			double			 average_latency;
+			double			 max_latency;
+		};
+
+		/**
+		 * @brief 创建inotify实例以及用于等待事件的epoll实例，所有路径共享同一个inotify实例
+		 */
+		DirWatchdog();
+
+		~DirWatchdog();
+
+		DirWatchdog(const DirWatchdog&) = delete;
+		DirWatchdog& operator=(const DirWatchdog&) = delete;
+
 		/**
 		 * @brief 添加一个路径到映射表
+		 * 使用BACKEND::POLL时由监控线程定期扫描，只产生以下事件：
+		 * 出现新的文件(或者同名文件被替换)时为IN_CREATE，已有的文件大小或者修改时间变化时为IN_MODIFY，
+		 * 文件变化之后在下一次扫描时没有再变化(写入完成)时为IN_CLOSE_WRITE | IN_MOVED_TO，文件消失时为IN_DELETE
 		 * @param path 要添加的路径
+		 * @param recursive 是否递归监控所有子目录，包括之后新建或者移入的子目录
+		 * @param backend 监控的方式
 		 * @return 添加是否成功
 		 */
-		bool AddPath(const std::string& path);
+		bool AddPath(const std::string& path, bool recursive = false, BACKEND backend = BACKEND::INOTIFY);
 
 		/**
-		 * @brief 通过路径获取fd
+		 * @brief 通过路径获取wd
 		 * @param path 目标路径
-		 * @return 获取的fd
+		 * @return 获取的wd，没有设置监控时为path_not_added_code，BACKEND::POLL的路径为小于path_not_added_code的编号
 		 */
-		int	 GetPathFd(const std::string& path);
+		int	 GetPathWd(const std::string& path);
 
 		/**
 		 * @brief 设置目标路径监控的事件
@@ -95,28 +179,294 @@ namespace work {
 		bool SetCallback(const std::string& path, const callback_type& callback, bool overwrite = false);
 
 		/**
-		 * @brief 开始监控目标路径，如此设计是允许用户多线程运行watchdog
-		 * @param path 目标路径
+		 * @brief 设置合并事件的静默时间，需要在Run之前调用
+		 * 同一个路径下同一个文件名的事件在静默时间内重复出现时合并为一次分发，事件的代码为所有被合并的事件的按位或
+		 * 持续出现的事件最多等待max_coalesce_multiple倍的静默时间
+		 * @param quiet_window 静默时间，为0时不合并(默认)
+		 */
+		void SetQuietWindow(std::chrono::milliseconds quiet_window);
+
+		/**
+		 * @brief 设置BACKEND::POLL的路径的扫描间隔，需要在SetWatch之前调用
+		 * 扫描发现变化时使用最短间隔，否则每次加倍直到最长间隔
+		 * @param min_interval 最短间隔
+		 * @param max_interval 最长间隔
+		 */
+		void SetPollInterval(std::chrono::milliseconds min_interval, std::chrono::milliseconds max_interval);
+
+		/**
+		 * @brief 在当前线程中监控所有路径，直到Stop被调用
+		 * 所有路径的事件都由同一个epoll循环读取，这里只解码事件并放入分发队列，不执行回调函数
+		 * BACKEND::POLL的路径也在这个循环中扫描，epoll_wait只等到下一次扫描的时间
+		 */
+		void Run();
+
+		/**
+		 * @brief 在当前线程中从分发队列取出事件并执行对应路径的回调函数，直到Stop被调用并且队列为空
+		 * 可以在多个线程中同时运行，此时同一个路径的回调函数可能被同时调用
+		 */
+		void Dispatch();
+
+		/**
+		 * @brief 让Run以及Dispatch返回，可以在任意线程中调用
+		 */
+		void Stop();
+
+		/**
+		 * @brief 获取分发的统计信息
+		 * @param reset 是否重置延迟以及队列峰值
+		 * @return 统计信息
 		 */
-		void Run(const std::string& path);
+		DispatchMetrics GetDispatchMetrics(bool reset = false);
 
 	private:
 		/**
-		 * @brief 监控的路径 <-> 路径对应的file descriptor
+		 * @brief 扫描时一个文件的快照
+		 */
+		struct PollFile {
+			uint64_t inode;
+			uint64_t size;
+			// 修改时间(纳秒)
+			int64_t	 mtime;
+			// 上一次扫描之后没有变化
+			bool		 stable;
+		};
+
+		/**
+		 * @brief 扫描时一个目录的快照
+		 */
+		struct PollDirectory {
+			uint64_t																	inode			= 0;
+			// 修改时间(纳秒)，没有变化时不需要重新读取目录
+			int64_t																		mtime			= -1;
+			// 上一次读取目录的时间(纳秒)
+			int64_t																		listed_at = 0;
+			// 变化之后还没有确认写入完成的文件数，不为0时每次都需要检查这些文件
+			std::size_t																unstable	= 0;
+			// 文件名 <-> 文件的快照
+			std::unordered_map<std::string, PollFile> files;
+			// 子目录名，只在递归时记录
+			std::vector<std::string>									dirs;
+		};
+
+		/**
+		 * @brief 一个扫描的路径的状态
+		 */
+		struct PollState {
+			// 相对于被监控路径的目录 <-> 目录的快照，被监控路径本身为空，std::map便于按照前缀删除子树
+			std::map<std::string, PollDirectory>	dirs;
+			// 当前的扫描间隔以及下一次扫描的时间
+			std::chrono::milliseconds							interval{0};
+			std::chrono::steady_clock::time_point next;
+			// 被监控路径是否可以访问，只在变化时输出日志
+			bool																	available = true;
+		};
+
+		/**
+		 * @brief 一个被监控的路径
+		 */
+		struct Entry {
+			std::string													 path;
+			int																	 wd				 = path_not_added_code;
+			event_underlying_type								 mask			 = 0;
+			bool																 recursive = false;
+			// 分发队列中的事件持有回调函数的所有权
+			std::shared_ptr<const callback_type> callback;
+			// 使用BACKEND::POLL时的状态，使用inotify时为空
+			std::unique_ptr<PollState>					 poll;
+		};
+
+		/**
+		 * @brief 一个wd，被监控路径本身或者递归监控的子目录，只保存父目录的wd和目录名，完整路径按需拼接
+		 */
+		struct Watch {
+			Entry*			entry;
+			// 被监控路径本身为path_not_added_code
+			int					parent;
+			std::string name;
+			// 子目录名 <-> 子目录的wd，移除子树时只需要遍历子树
+			std::unordered_map<std::string, int> children;
+		};
+
+		/**
+		 * @brief 已经解码，等待分发的事件
+		 */
+		struct PendingEvent {
+			std::shared_ptr<const callback_type>	callback;
+			event_underlying_type									mask;
+			std::string														name;
+			// 读取到事件的时间
+			std::chrono::steady_clock::time_point time;
+		};
+
+		/**
+		 * @brief 等待合并的事件
+		 */
+		struct CoalescingEvent {
+			std::shared_ptr<const callback_type>	callback;
+			event_underlying_type									mask;
+			// 第一个事件的时间与截止时间(最后一个事件的时间加上静默时间，不超过最长的等待时间)
+			std::chrono::steady_clock::time_point first;
+			std::chrono::steady_clock::time_point deadline;
+		};
+
+		using coalesce_key_type = std::pair<int, std::string>;
+
+		/**
+		 * @brief 读取并分发inotify实例中所有已经就绪的事件
+		 * @return inotify实例是否依然可用
+		 */
+		bool DoReadEvents();
+
+		/**
+		 * @brief 处理一个目录事件(递归监控)，为新目录添加监控，为移出的目录移除监控，
+		 * 在树中移动的目录(IN_MOVED_FROM与IN_MOVED_TO的cookie相同)只更新位置，不重新扫描其中的文件
+		 * @param cookie 移动事件的cookie，用于配对IN_MOVED_FROM与IN_MOVED_TO
+		 * @return 是否成功，已经停止时返回false
+		 */
+		bool DoHandleDirEvent(int wd, const Watch& watch, event_underlying_type mask, uint32_t cookie, const std::string& name);
+
+		/**
+		 * @brief 为目录以及它的所有子目录添加监控
+		 * @param entry 所属的被监控路径
+		 * @param parent 父目录的wd
+		 * @param name 目录名
+		 * @param report_files 是否为目录中已有的文件分发IN_SCANNED事件，新建的目录需要，避免丢失添加监控之前写入的文件
+		 * @return 是否成功，已经停止时返回false
+		 */
+		bool DoAddSubtree(Entry& entry, int parent, const std::string& name, bool report_files);
+
+		/**
+		 * @brief 为目录中的所有子目录添加监控
+		 * @param entry 所属的被监控路径
+		 * @param wd 目录的wd
+		 * @param report_files 是否为目录中已有的文件分发IN_SCANNED事件
+		 * @return 是否成功，已经停止时返回false
+		 */
+		bool DoScanDirectory(Entry& entry, int wd, bool report_files);
+
+		/**
+		 * @brief 添加或者更新一个wd的位置，同时维护父目录的子目录索引
+		 * @param wd 目录的wd
+		 * @param entry 所属的被监控路径
+		 * @param parent 父目录的wd，被监控路径本身为path_not_added_code
+		 * @param name 目录名
+		 */
+		void DoLinkWatch(int wd, Entry& entry, int parent, const std::string& name);
+
+		/**
+		 * @brief 从父目录的子目录索引中去掉一个wd
+		 * @param wd 目录的wd
+		 * @param watch 目录的详情
+		 */
+		void DoUnlinkWatch(int wd, const Watch& watch);
+
+		/**
+		 * @brief 移除一个目录以及它的所有子目录的监控
+		 * @param wd 目录的wd
+		 */
+		void DoRemoveSubtree(int wd);
+
+		/**
+		 * @brief 获取wd下的名字相对于被监控路径的路径
+		 * @param wd 目录的wd
+		 * @param name 目录中的名字，可以为空
+		 * @return 相对路径
+		 */
+		std::string DoGetRelativePath(int wd, const std::string& name) const;
+
+		/**
+		 * @brief 将一个事件放入分发队列，需要合并时先放入等待合并的事件中
+		 * @param wd 事件所在目录的wd
+		 * @param entry 所属的被监控路径
+		 * @param mask 事件的代码
+		 * @param name 相对于被监控路径的路径
+		 * @return 是否成功，已经停止时返回false
+		 */
+		bool DoEnqueue(int wd, const Entry& entry, event_underlying_type mask, std::string name);
+
+		/**
+		 * @brief 将已经到达截止时间的等待合并的事件放入分发队列
+		 * @return 距离下一个截止时间的毫秒数，没有等待合并的事件时为-1
 		 */
-		std::map<std::string, int>					 path_fd_;
+		int	 DoFlushCoalescing();
+
+		/**
+		 * @brief 扫描所有已经到达扫描时间的BACKEND::POLL的路径，并调整它们的扫描间隔
+		 * @return 距离下一次扫描的毫秒数，没有需要扫描的路径时为-1
+		 */
+		int	 DoPoll();
+
+		/**
+		 * @brief 扫描一个路径中的所有目录，与快照比较并分发变化
+		 * @param entry 被监控的路径
+		 * @param baseline 是否只建立快照而不分发事件(设置监控时)
+		 * @param changed 输出是否有变化
+		 * @return 是否成功，已经停止时返回false
+		 */
+		bool DoPollEntry(Entry& entry, bool baseline, bool& changed);
+
 		/**
-		 * @brief file_descriptor <-> watch_descriptor
+		 * @brief 扫描一个目录，目录的修改时间没有变化时不读取目录，只检查需要检查的文件
+		 * @param entry 被监控的路径
+		 * @param relative 相对于被监控路径的目录
+		 * @param baseline 是否只建立快照而不分发事件
+		 * @param changed 输出是否有变化
+		 * @param dirs 输出子目录(相对路径)，只在递归时输出
+		 * @return 是否成功，已经停止时返回false
 		 */
-		std::map<int, int>									 fd_wd_;
+		bool DoPollDirectory(Entry& entry, const std::string& relative, bool baseline, bool& changed, std::vector<std::string>& dirs);
+
+		// 读取事件的缓冲区，new分配的内存满足inotify_event的对齐要求
+		std::unique_ptr<char[]>						 read_buffer_;
+		// inotify实例
+		int																 inotify_fd_;
+		// epoll实例，等待inotify_fd_以及stop_fd_
+		int																 epoll_fd_;
+		// 用于唤醒并结束Run的eventfd
+		int																 stop_fd_;
+		/**
+		 * @brief 监控的路径 <-> 路径的详情，std::map保证Entry的地址不变
+		 */
+		std::map<std::string, Entry>			 path_entry_;
 		/**
-		 * @brief file_descriptor <-> event_mask
+		 * @brief watch_descriptor <-> 监控的目录，只在监控线程中修改(Run之前由SetWatch修改)
 		 */
-		std::map<int, event_underlying_type> fd_mask_;
+		std::unordered_map<int, Watch>		 watches_;
 		/**
-		 * @brief file_descriptor <-> callback
+		 * @brief 移动事件的cookie <-> 收到IN_MOVED_FROM的目录的wd(已经从父目录中断开)，
+		 * 读完所有就绪的事件后仍然没有配对的目录被移出了监控的树
 		 */
-		std::map<int, callback_type>				 fd_callback_;
+		std::unordered_map<uint32_t, int>	 moved_from_;
+		/**
+		 * @brief 等待分发的事件
+		 */
+		BoundedQueue<PendingEvent>				 dispatch_queue_{dispatch_queue_capacity};
+		// 分发的事件数，延迟的总和与最大值(纳秒)，上一次重置之后
+		std::atomic<uint64_t>							 dispatched_{0};
+		std::atomic<uint64_t>							 window_dispatched_{0};
+		std::atomic<uint64_t>							 total_latency_{0};
+		std::atomic<uint64_t>							 max_latency_{0};
+		std::atomic<uint64_t>							 coalesced_{0};
+		std::atomic<uint64_t>							 events_{0};
+		std::atomic<uint64_t>							 window_events_{0};
+		std::atomic<uint64_t>							 overflows_{0};
+		// 上一次重置统计信息的时间
+		std::mutex												 metrics_mutex_;
+		std::chrono::steady_clock::time_point window_start_ = std::chrono::steady_clock::now();
+
+		// 合并事件的静默时间
+		std::chrono::milliseconds																				 quiet_window_{0};
+		// (wd, 文件名) <-> 等待合并的事件，只在监控线程中访问
+		std::map<coalesce_key_type, CoalescingEvent>											 coalescing_;
+		// 截止时间 <-> (wd, 文件名)，截止时间被推迟之后旧的项在取出时跳过
+		std::multimap<std::chrono::steady_clock::time_point, coalesce_key_type> deadline_;
+
+		// BACKEND::POLL的扫描间隔
+		std::chrono::milliseconds																				 poll_min_interval_{1000};
+		std::chrono::milliseconds																				 poll_max_interval_{16000};
+		// 下一个分配给BACKEND::POLL的路径的编号，代替wd用于合并事件
+		int																															 next_poll_id_ = path_not_added_code - 1;
 	};
 }// namespace work
 
@@ -1,40 +1,626 @@
 #include "error_logger.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cstdlib>
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+std::atomic<int>				 g_log_level{static_cast<int>(LOG_LEVEL::INFO)};
+std::atomic<std::size_t> g_log_rate_limit[3]{{0}, {0}, {0}};
 
 namespace {
-	std::mutex										 g_log_mutex;
-	std::once_flag								 g_log_once_flag;
-	const char*										 g_log_filename = "logger_output.txt";
-	std::shared_ptr<std::ofstream> g_log_output_ptr;
+	const char* g_log_filename				= "logger_output.txt";
+	const char* g_binary_log_filename = "logger_output.bin";
+
+	/**
+	 * @brief 一条还没有写出的日志
+	 */
+	struct LogRecord {
+		// 全局的序号，写出时按照序号排序
+		uint64_t					 sequence;
+		LOG_LEVEL					 level;
+		const LogLocation* where;
+		std::string				 what;
+	};
+
+	/**
+	 * @brief 一个线程的日志缓冲区，单生产者(所属线程)单消费者(后台线程)的环形队列，不需要加锁
+	 */
+	class LogRing {
+	public:
+		explicit LogRing(std::size_t capacity)
+			: records_(DoRoundUp(capacity)),
+				mask_(records_.size() - 1) {}
+
+		/**
+		 * @brief 放入一条日志，只能在所属线程中调用
+		 * @param record 日志
+		 * @return 是否放入，缓冲区满时返回false
+		 */
+		bool TryPush(LogRecord& record) {
+			auto head = head_.load(std::memory_order_relaxed);
+			if (head - tail_.load(std::memory_order_acquire) > mask_) {
+				return false;
+			}
+			records_[head & mask_] = std::move(record);
+			head_.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * @brief 缓冲区是否已满，只能在所属线程中调用(之后只有后台线程取出，不满时直到放入之前都不会变满)
+		 * @return 是否已满
+		 */
+		bool Full() const {
+			return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire) > mask_;
+		}
+
+		/**
+		 * @brief 获取缓冲区中的日志条数
+		 * @return 条数
+		 */
+		std::size_t Size() const {
+			return static_cast<std::size_t>(head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire));
+		}
+
+		/**
+		 * @brief 获取容量
+		 * @return 容量
+		 */
+		std::size_t Capacity() const {
+			return records_.size();
+		}
+
+		/**
+		 * @brief 取出所有的日志，只能在后台线程中调用
+		 * @param out 输出取出的日志
+		 */
+		void Drain(std::vector<LogRecord>& out) {
+			auto tail = tail_.load(std::memory_order_relaxed);
+			auto head = head_.load(std::memory_order_acquire);
+			for (; tail != head; ++tail) {
+				out.push_back(std::move(records_[tail & mask_]));
+			}
+			tail_.store(tail, std::memory_order_release);
+		}
+
+		/**
+		 * @brief 所属线程已经结束，之后不会再放入日志
+		 */
+		std::atomic<bool> orphaned{false};
+
+	private:
+		static std::size_t DoRoundUp(std::size_t capacity) {
+			std::size_t ret = 2;
+			while (ret < capacity) {
+				ret <<= 1;
+			}
+			return ret;
+		}
+
+		std::vector<LogRecord> records_;
+		const std::size_t			 mask_;
+		// 生产者与消费者的位置放在不同的缓存行中
+		char									 head_padding_[64];
+		std::atomic<uint64_t>	 head_{0};
+		char									 tail_padding_[64];
+		std::atomic<uint64_t>	 tail_{0};
+	};
+
+	/**
+	 * @brief 线程结束时标记它的缓冲区，由后台线程取出剩下的日志之后移除
+	 */
+	struct LogRingHolder {
+		std::shared_ptr<LogRing> ring;
+
+		~LogRingHolder() {
+			if (ring) {
+				ring->orphaned.store(true, std::memory_order_release);
+			}
+		}
+	};
+
+	thread_local LogRingHolder t_log_ring;
+
+	template<typename T>
+	void DoAppendBinary(std::string& out, T value) {
+		out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	void DoAppendBinary(std::string& out, const char* data, std::size_t size) {
+		DoAppendBinary(out, static_cast<uint32_t>(size));
+		out.append(data, size);
+	}
+
+	/**
+	 * @brief 读取编码后的参数中的一个值
+	 * @return 是否读取，剩下的长度不够时返回false
+	 */
+	template<typename T>
+	bool DoReadArg(const char*& begin, const char* end, T& value) {
+		if (static_cast<std::size_t>(end - begin) < sizeof(value)) {
+			return false;
+		}
+		std::memcpy(&value, begin, sizeof(value));
+		begin += sizeof(value);
+		return true;
+	}
+
+	/**
+	 * @brief 输出编码后的参数中的下一个参数
+	 * @return 是否输出，参数损坏时返回false
+	 */
+	bool DoRenderArg(std::string& out, const char*& begin, const char* end) {
+		LOG_ARG type;
+		if (!DoReadArg(begin, end, type)) {
+			return false;
+		}
+		switch (type) {
+			case LOG_ARG::INT: {
+				int64_t value;
+				if (!DoReadArg(begin, end, value)) {
+					return false;
+				}
+				out += std::to_string(value);
+				return true;
+			}
+			case LOG_ARG::UINT: {
+				uint64_t value;
+				if (!DoReadArg(begin, end, value)) {
+					return false;
+				}
+				out += std::to_string(value);
+				return true;
+			}
+			case LOG_ARG::DOUBLE: {
+				double value;
+				if (!DoReadArg(begin, end, value)) {
+					return false;
+				}
+				out += std::to_string(value);
+				return true;
+			}
+			case LOG_ARG::STRING: {
+				uint32_t length;
+				if (!DoReadArg(begin, end, length) || static_cast<std::size_t>(end - begin) < length) {
+					return false;
+				}
+				out.append(begin, length);
+				begin += length;
+				return true;
+			}
+			default:
+				return false;
+		}
+	}
+
+	/**
+	 * @brief 把格式中的{}依次替换为参数，多余的参数用空格分隔追加在最后
+	 */
+	void DoRender(std::string& out, const char* format, const std::string& args) {
+		auto begin = args.data();
+		auto end	 = begin + args.size();
+		for (auto p = format; *p != '\0'; ++p) {
+			if (p[0] == '{' && p[1] == '}' && begin != end) {
+				if (!DoRenderArg(out, begin, end)) {
+					out += "<corrupt arguments>";
+					return;
+				}
+				++p;
+			} else {
+				out += *p;
+			}
+		}
+		while (begin != end) {
+			out += ' ';
+			if (!DoRenderArg(out, begin, end)) {
+				out += "<corrupt arguments>";
+				return;
+			}
+		}
+	}
+
+	/**
+	 * @brief 每三位加上逗号，例如1,204,331
+	 */
+	std::string DoGroupDigits(uint64_t value) {
+		auto digits = std::to_string(value);
+		std::string ret;
+		for (std::size_t i = 0; i < digits.size(); ++i) {
+			if (i != 0 && (digits.size() - i) % 3 == 0) {
+				ret += ',';
+			}
+			ret += digits[i];
+		}
+		return ret;
+	}
+
+	/**
+	 * @brief 异步日志，所有线程把日志放入自己的缓冲区，后台线程定期取出所有缓冲区中的日志，排序之后一次写入文件
+	 */
+	class AsyncLogger {
+	public:
+		/**
+		 * @brief 获取唯一的实例，实例不会被析构，程序退出时(atexit)停止后台线程并写出剩下的日志
+		 * 之后输出的日志直接写入文件
+		 */
+		static AsyncLogger& Instance() {
+			static auto* logger = new AsyncLogger;
+			return *logger;
+		}
+
+		void Push(LOG_LEVEL level, const LogLocation& where, std::string&& what) {
+			if (stopped_.load(std::memory_order_acquire)) {
+				std::lock_guard<std::mutex> lock(write_mutex_);
+				std::string									buffer;
+				auto												binary = DoGetFormat() == LOG_FORMAT::BINARY;
+				DoAppend(buffer, binary, level, where, what);
+				DoWrite(buffer, binary);
+				return;
+			}
+
+			auto& ring = DoGetRing();
+			while (ring.Full()) {
+				if (static_cast<LOG_OVERFLOW>(overflow_.load(std::memory_order_relaxed)) == LOG_OVERFLOW::DROP) {
+					dropped_.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				// 等待后台线程取出
+				Wake();
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+			// 有空间之后才分配序号，等待期间其他线程的日志不会排在这一条之前却先写出
+			LogRecord record{sequence_.fetch_add(1, std::memory_order_relaxed), level, &where, std::move(what)};
+			ring.TryPush(record);
+
+			// 超过一半时提前写出，减少阻塞或者丢弃
+			if (ring.Size() == ring.Capacity() / 2) {
+				Wake();
+			}
+		}
+
+		void SetOption(const LogOption& option) {
+			g_log_level.store(static_cast<int>(option.level), std::memory_order_relaxed);
+			flush_interval_.store(std::max<std::size_t>(option.flush_interval, 1), std::memory_order_relaxed);
+			buffer_size_.store(option.buffer_size, std::memory_order_relaxed);
+			overflow_.store(static_cast<int>(option.overflow), std::memory_order_relaxed);
+			for (std::size_t i = 0; i < 3; ++i) {
+				g_log_rate_limit[i].store(option.rate_limit[i], std::memory_order_relaxed);
+			}
+			format_.store(static_cast<int>(option.format), std::memory_order_relaxed);
+		}
+
+		void Flush() {
+			auto												 target = sequence_.load(std::memory_order_relaxed);
+			std::unique_lock<std::mutex> lock(mutex_);
+			wake_ = true;
+			wake_cv_.notify_one();
+			written_cv_.wait(lock, [this, target] {
+				return written_.load(std::memory_order_acquire) >= target || stopped_.load(std::memory_order_acquire);
+			});
+		}
+
+		uint64_t GetDropped() const {
+			return dropped_.load(std::memory_order_relaxed);
+		}
+
+		uint64_t GetSuppressed() const {
+			return suppressed_.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief 注册一个抑制了日志的限流器，后台线程定期汇总它抑制的条数
+		 */
+		void AddLimiter(LogLimiter* limiter) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			limiters_.push_back(limiter);
+		}
+
+	private:
+		AsyncLogger()
+			: output_(g_log_filename, std::ios::app | std::ios::out),
+				thread_(&AsyncLogger::DoRun, this) {
+			std::atexit([]() { Instance().DoStop(); });
+		}
+
+		LOG_FORMAT DoGetFormat() const {
+			return static_cast<LOG_FORMAT>(format_.load(std::memory_order_relaxed));
+		}
+
+		void Wake() {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				wake_ = true;
+			}
+			wake_cv_.notify_one();
+		}
+
+		LogRing& DoGetRing() {
+			if (!t_log_ring.ring) {
+				t_log_ring.ring = std::make_shared<LogRing>(buffer_size_.load(std::memory_order_relaxed));
+				std::lock_guard<std::mutex> lock(mutex_);
+				rings_.push_back(t_log_ring.ring);
+			}
+			return *t_log_ring.ring;
+		}
+
+		void DoRun() {
+			std::vector<std::shared_ptr<LogRing>> rings;
+			std::vector<LogRecord>								batch;
+			std::string														buffer;
+			for (;;) {
+				bool stopping;
+				{
+					std::unique_lock<std::mutex> lock(mutex_);
+					wake_cv_.wait_for(lock, std::chrono::milliseconds(flush_interval_.load(std::memory_order_relaxed)), [this] { return wake_ || stopping_; });
+					wake_		 = false;
+					stopping = stopping_;
+					rings		 = rings_;
+				}
+
+				DoDrain(rings, batch, buffer, stopping);
+				if (stopping) {
+					return;
+				}
+			}
+		}
+
+		/**
+		 * @brief 取出所有缓冲区中的日志并写入文件，移除已经结束的线程的缓冲区，
+		 * 每秒(或者final为true时)汇总一次被限流器抑制的日志
+		 */
+		void DoDrain(const std::vector<std::shared_ptr<LogRing>>& rings, std::vector<LogRecord>& batch, std::string& buffer, bool final) {
+			batch.clear();
+			bool has_orphaned = false;
+			for (const auto& ring: rings) {
+				// 先读取标记再取出，保证取出了这个线程所有的日志
+				has_orphaned = ring->orphaned.load(std::memory_order_acquire) || has_orphaned;
+				ring->Drain(batch);
+			}
+			// 不同线程的日志按照调用的顺序写出
+			std::sort(batch.begin(), batch.end(), [](const LogRecord& lhs, const LogRecord& rhs) {
+				return lhs.sequence < rhs.sequence;
+			});
+
+			{
+				std::lock_guard<std::mutex> lock(write_mutex_);
+				buffer.clear();
+				auto binary	 = DoGetFormat() == LOG_FORMAT::BINARY;
+				auto dropped = dropped_.load(std::memory_order_relaxed);
+				if (dropped != reported_dropped_) {
+					static constexpr LogLocation location{__FILE__, __LINE__, __PRETTY_FUNCTION__, "{} log messages dropped, log buffer full"};
+					std::string									 what;
+					LogEncodeArgs(what, dropped - reported_dropped_);
+					DoAppend(buffer, binary, LOG_LEVEL::WARNING, location, what);
+					reported_dropped_ = dropped;
+				}
+				for (const auto& record: batch) {
+					DoAppend(buffer, binary, record.level, *record.where, record.what);
+				}
+				DoAppendSuppressed(buffer, binary, final);
+				if (!buffer.empty()) {
+					DoWrite(buffer, binary);
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (has_orphaned) {
+					rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<LogRing>& ring) {
+												 return ring->orphaned.load(std::memory_order_acquire) && ring->Size() == 0;
+											 }),
+											 rings_.end());
+				}
+				written_.fetch_add(batch.size(), std::memory_order_release);
+			}
+			written_cv_.notify_all();
+		}
+
+		/**
+		 * @brief 输出一条日志到缓冲区，需要持有write_mutex_
+		 * 二进制格式下第一次遇到的调用位置先输出它的定义
+		 */
+		void DoAppend(std::string& buffer, bool binary, LOG_LEVEL level, const LogLocation& where, const std::string& what) {
+			if (!binary) {
+				FormatLogLine(buffer, level, where, what);
+				return;
+			}
+
+			auto it = site_ids_.find(&where);
+			if (it == site_ids_.end()) {
+				it = site_ids_.emplace(&where, static_cast<uint32_t>(site_ids_.size())).first;
+				buffer += static_cast<char>(LOG_RECORD::SITE);
+				DoAppendBinary(buffer, it->second);
+				DoAppendBinary(buffer, static_cast<int32_t>(where.line));
+				DoAppendBinary(buffer, where.file, std::strlen(where.file));
+				DoAppendBinary(buffer, where.function, std::strlen(where.function));
+				DoAppendBinary(buffer, where.format, where.format == nullptr ? 0 : std::strlen(where.format));
+			}
+			buffer += static_cast<char>(LOG_RECORD::ENTRY);
+			DoAppendBinary(buffer, it->second);
+			DoAppendBinary(buffer, static_cast<uint8_t>(level));
+			DoAppendBinary(buffer, what.data(), what.size());
+		}
+
+		/**
+		 * @brief 输出被限流器抑制的条数，需要持有write_mutex_，只在后台线程(或者停止时)调用
+		 */
+		void DoAppendSuppressed(std::string& buffer, bool binary, bool final) {
+			auto now = std::chrono::steady_clock::now();
+			if (!final && now - suppressed_reported_at_ < std::chrono::seconds(1)) {
+				return;
+			}
+			suppressed_reported_at_ = now;
+
+			std::vector<LogLimiter*> limiters;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				limiters = limiters_;
+			}
+			std::string what;
+			for (auto* limiter: limiters) {
+				LOG_LEVEL level;
+				auto			count = limiter->TakeSuppressed(level);
+				if (count == 0) {
+					continue;
+				}
+				suppressed_.fetch_add(count, std::memory_order_relaxed);
+				what.clear();
+				LogEncodeArgs(what, DoGroupDigits(count));
+				DoAppend(buffer, binary, level, limiter->GetSummaryLocation(), what);
+			}
+		}
+
+		/**
+		 * @brief 写入文件，需要持有write_mutex_，二进制文件在第一次写入时打开
+		 */
+		void DoWrite(const std::string& buffer, bool binary) {
+			auto& output = binary ? binary_output_ : output_;
+			if (binary && !binary_output_.is_open()) {
+				binary_output_.open(g_binary_log_filename, std::ios::app | std::ios::out | std::ios::binary);
+				binary_output_.write(log_binary_magic, static_cast<std::streamsize>(std::strlen(log_binary_magic)));
+			}
+			output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			output.flush();
+		}
+
+		void DoStop() {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stopping_ = true;
+			}
+			wake_cv_.notify_one();
+			thread_.join();
+
+			// 之后的日志直接写入文件，再取出一次停止之前刚刚放入的日志
+			stopped_.store(true, std::memory_order_release);
+			std::vector<std::shared_ptr<LogRing>> rings;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				rings = rings_;
+			}
+			std::vector<LogRecord> batch;
+			std::string						 buffer;
+			DoDrain(rings, batch, buffer, true);
+		}
+
+		std::ofstream													output_;
+		std::ofstream													binary_output_;
+		// 二进制格式下已经定义的调用位置的编号
+		std::unordered_map<const LogLocation*, uint32_t> site_ids_;
+		// 保护output_、binary_output_与site_ids_
+		std::mutex														write_mutex_;
+
+		// 保护下面的数据
+		std::mutex														mutex_;
+		std::condition_variable								wake_cv_;
+		std::condition_variable								written_cv_;
+		bool																	wake_			= false;
+		bool																	stopping_ = false;
+		// 所有线程的缓冲区
+		std::vector<std::shared_ptr<LogRing>> rings_;
+
+		std::atomic<uint64_t>									sequence_{0};
+		// 已经写出或者丢弃的日志条数
+		std::atomic<uint64_t>									written_{0};
+		std::atomic<uint64_t>									dropped_{0};
+		// 注册的限流器，限流器都是静态变量，不需要移除
+		std::vector<LogLimiter*>							limiters_;
+		// 已经汇总输出的被抑制的条数
+		std::atomic<uint64_t>									suppressed_{0};
+		// 只在后台线程中访问
+		uint64_t															reported_dropped_ = 0;
+		std::chrono::steady_clock::time_point suppressed_reported_at_;
+		std::atomic<bool>											stopped_{false};
+
+		std::atomic<std::size_t>							flush_interval_{LogOption{}.flush_interval};
+		std::atomic<std::size_t>							buffer_size_{LogOption{}.buffer_size};
+		std::atomic<int>											overflow_{static_cast<int>(LogOption{}.overflow)};
+		std::atomic<int>											format_{static_cast<int>(LogOption{}.format)};
+
+		std::thread														thread_;
+	};
 }// namespace
 
-void LogToFile(LOG_LEVEL level, const std::string& where, const std::string& what) {
-	std::lock_guard<std::mutex> lock(g_log_mutex);
+bool LogLimiter::DoAcquire(LOG_LEVEL level, std::size_t rate) {
+	// 每个令牌的间隔，桶的容量为1秒的令牌
+	auto interval = std::max<int64_t>(static_cast<int64_t>(1000000000 / rate), 1);
+	auto capacity = interval * static_cast<int64_t>(rate);
+	auto now			= std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	auto arrival	= arrival_.load(std::memory_order_relaxed);
+	for (;;) {
+		auto next = std::max<int64_t>(arrival, now) + interval;
+		if (next - now > capacity) {
+			break;
+		}
+		if (arrival_.compare_exchange_weak(arrival, next, std::memory_order_relaxed)) {
+			return true;
+		}
+	}
 
-	std::call_once(
-			g_log_once_flag,
-			[](std::shared_ptr<std::ofstream>& p) -> void {
-				p = std::make_shared<std::ofstream>(g_log_filename, std::ios::app | std::ios::out);
-			},
-			std::ref(g_log_output_ptr));
+	level_.store(static_cast<int>(level), std::memory_order_relaxed);
+	suppressed_.fetch_add(1, std::memory_order_relaxed);
+	if (!registered_.load(std::memory_order_relaxed) && !registered_.exchange(true, std::memory_order_relaxed)) {
+		AsyncLogger::Instance().AddLimiter(this);
+	}
+	return false;
+}
+
+void LogToFile(LOG_LEVEL level, const LogLocation& where, std::string what) {
+	AsyncLogger::Instance().Push(level, where, std::move(what));
+}
 
+void SetLogOption(const LogOption& option) {
+	AsyncLogger::Instance().SetOption(option);
+}
+
+void FlushLog() {
+	AsyncLogger::Instance().Flush();
+}
+
+void FormatLogLine(std::string& out, LOG_LEVEL level, const LogLocation& where, const std::string& what) {
 	switch (level) {
 		case LOG_LEVEL::INFO:
-			g_log_output_ptr.operator*() << "INFO:\t";
+			out += "INFO:\t";
 			break;
 		case LOG_LEVEL::WARNING:
-			g_log_output_ptr.operator*() << "WARNING:\t";
+			out += "WARNING:\t";
 			break;
 		case LOG_LEVEL::ERROR:
-			g_log_output_ptr.operator*() << "ERROR:\t";
+			out += "ERROR:\t";
 			break;
 		default:
-			g_log_output_ptr.operator*() << "UNKNOWN:\t";
+			out += "UNKNOWN:\t";
 			break;
 	}
 
-	g_log_output_ptr.operator*() << where << "\t-->\t" << what << std::endl;
+	out += "FILE:\t";
+	out += where.file;
+	out += "\tLINE:\t";
+	out += std::to_string(where.line);
+	out += "\tFUNCTION:\t";
+	out += where.function;
+	out += "\t-->\t";
+	if (where.format == nullptr) {
+		out += what;
+	} else {
+		DoRender(out, where.format, what);
+	}
+	out += '\n';
+}
+
+uint64_t GetDroppedLogCount() {
+	return AsyncLogger::Instance().GetDropped();
+}
+
+uint64_t GetSuppressedLogCount() {
+	return AsyncLogger::Instance().GetSuppressed();
 }
@@ -1,7 +1,11 @@
 #ifndef ERROR_LOGGER_HPP
 #define ERROR_LOGGER_HPP
 
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <type_traits>
 
 enum class LOG_LEVEL {
 	INFO,
@@ -10,17 +14,303 @@ enum class LOG_LEVEL {
 };
 
 /**
- * @brief 日志
+ * @brief 编译时的日志级别，低于这个级别的日志不会被编译(连参数也不会求值)，
+ * 0为INFO，1为WARNING，2为ERROR，3为关闭所有日志，可以在编译时通过-DLOG_COMPILE_LEVEL=N指定
  */
-#define LOG2FILE(level, what) \
-	LogToFile(level, std::string{"FILE:\t"} + __FILE__ + "\tLINE:\t" + std::to_string(__LINE__) + "\tFUNCTION:\t" + __PRETTY_FUNCTION__, what)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0
+#endif
+
+/**
+ * @brief 日志的来源位置，每个调用位置一个静态常量，输出时才拼接
+ */
+struct LogLocation {
+	const char* file;
+	int					line;
+	const char* function;
+	/**
+	 * @brief LOG2FILE_ARGS的格式，其中的{}依次替换为参数，为nullptr时日志内容就是文本
+	 */
+	const char* format;
+};
+
+/**
+ * @brief 日志的输出格式
+ */
+enum class LOG_FORMAT {
+	// 文本，写入logger_output.txt
+	TEXT,
+	// 二进制，写入logger_output.bin，需要用log_decoder转换为文本
+	BINARY
+};
+
+/**
+ * @brief 二进制日志文件的格式，每次启动后第一次写入时先写入log_binary_magic，之后是若干条记录，
+ * 整数都是本机字节序，字符串都是4字节的长度加上内容：
+ * SITE 调用位置的定义：编号(4字节) 行号(4字节) 文件名 函数名 格式(为空表示日志内容就是文本)，同一个位置只定义一次
+ * ENTRY 一条日志：编号(4字节) 级别(1字节) 内容(文本或者编码后的参数)
+ * 编号在每次启动时从0开始
+ */
+enum class LOG_RECORD : char {
+	SITE	= 'S',
+	ENTRY = 'E'
+};
+
+constexpr const char* log_binary_magic = "WORKLOG1";
+
+/**
+ * @brief 日志缓冲区满时的处理方式
+ */
+enum class LOG_OVERFLOW {
+	// 等待后台线程写出
+	BLOCK,
+	// 丢弃这条日志并计数，后台线程会输出丢弃的数量
+	DROP
+};
+
+/**
+ * @brief 日志的选项
+ */
+struct LogOption {
+	/**
+	 * @brief 运行时的日志级别，低于这个级别的日志不求值参数，直接跳过
+	 */
+	LOG_LEVEL		 level					= LOG_LEVEL::INFO;
+	/**
+	 * @brief 后台线程写出日志的间隔(毫秒)，缓冲区超过一半时会提前写出
+	 */
+	std::size_t	 flush_interval = 200;
+	/**
+	 * @brief 每个线程的缓冲区能够容纳的日志条数
+	 */
+	std::size_t	 buffer_size		= 4096;
+	/**
+	 * @brief 缓冲区满时的处理方式
+	 */
+	LOG_OVERFLOW overflow				= LOG_OVERFLOW::BLOCK;
+	/**
+	 * @brief 输出格式
+	 */
+	LOG_FORMAT	 format					= LOG_FORMAT::TEXT;
+	/**
+	 * @brief 每个级别每个调用位置每秒最多输出的日志条数(令牌桶，最多积累1秒的令牌)，下标为LOG_LEVEL，0为不限制
+	 * 超过的日志不求值参数，被抑制的条数由后台线程定期(最多每秒一次)汇总输出
+	 */
+	std::size_t	 rate_limit[3]	= {0, 0, 0};
+};
+
+/**
+ * @brief 运行时的日志级别，由SetLogOption设置
+ */
+extern std::atomic<int> g_log_level;
+
+/**
+ * @brief 每个级别的限流速率，由SetLogOption设置
+ */
+extern std::atomic<std::size_t> g_log_rate_limit[3];
+
+/**
+ * @brief 一个调用位置的限流器，令牌桶使用GCRA实现，只需要一个原子变量
+ * 在宏中作为静态变量，常量初始化，不需要加锁
+ */
+class LogLimiter {
+public:
+	constexpr explicit LogLimiter(const LogLocation& where)
+		: summary_{where.file, where.line, where.function, "{} similar messages suppressed"} {}
+
+	/**
+	 * @brief 获取一个令牌
+	 * @param level 日志级别
+	 * @return 是否可以输出，不能输出时计入被抑制的条数
+	 */
+	bool Acquire(LOG_LEVEL level) {
+		auto rate = g_log_rate_limit[static_cast<int>(level)].load(std::memory_order_relaxed);
+		return rate == 0 || DoAcquire(level, rate);
+	}
+
+	/**
+	 * @brief 取出被抑制的条数，只由后台线程调用
+	 * @param level 输出被抑制的日志的级别
+	 * @return 被抑制的条数
+	 */
+	uint64_t TakeSuppressed(LOG_LEVEL& level) {
+		level = static_cast<LOG_LEVEL>(level_.load(std::memory_order_relaxed));
+		return suppressed_.exchange(0, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief 输出汇总时使用的位置，与调用位置相同
+	 */
+	const LogLocation& GetSummaryLocation() const {
+		return summary_;
+	}
+
+private:
+	bool								 DoAcquire(LOG_LEVEL level, std::size_t rate);
+
+	const LogLocation		 summary_;
+	// 理论上下一个令牌到达的时间(纳秒)
+	std::atomic<int64_t> arrival_{0};
+	std::atomic<uint64_t> suppressed_{0};
+	std::atomic<int>		 level_{0};
+	// 第一次抑制时注册到后台线程
+	std::atomic<bool>		 registered_{false};
+};
+
+/**
+ * @brief 判断一个级别的日志在运行时是否需要输出
+ * @param level 日志级别
+ * @return 是否需要输出
+ */
+inline bool IsLogEnabled(LOG_LEVEL level) {
+	return static_cast<int>(level) >= g_log_level.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief 日志，级别被禁用或者被限流时不会求值what，也不会构造任何字符串
+ */
+#define LOG2FILE(level, what)                                                                             \
+	do {                                                                                                    \
+		if (static_cast<int>(level) >= LOG_COMPILE_LEVEL && IsLogEnabled(level)) {                            \
+			static constexpr LogLocation log2file_location{__FILE__, __LINE__, __PRETTY_FUNCTION__, nullptr}; \
+			static LogLimiter						 log2file_limiter{log2file_location};                                 \
+			if (log2file_limiter.Acquire(level)) {                                                              \
+				LogToFile(level, log2file_location, what);                                                        \
+			}                                                                                                   \
+		}                                                                                                     \
+	} while (0)
+
+/**
+ * @brief 按照格式输出日志，调用时只记录原始的参数(整数、浮点数、字符串)，在后台线程或者log_decoder中才替换格式中的{}，
+ * 级别被禁用或者被限流时不会求值参数，format必须是字符串字面量
+ */
+#define LOG2FILE_ARGS(level, format, ...)                                                                \
+	do {                                                                                                   \
+		if (static_cast<int>(level) >= LOG_COMPILE_LEVEL && IsLogEnabled(level)) {                           \
+			static constexpr LogLocation log2file_location{__FILE__, __LINE__, __PRETTY_FUNCTION__, format}; \
+			static LogLimiter						 log2file_limiter{log2file_location};                                \
+			if (log2file_limiter.Acquire(level)) {                                                             \
+				LogToFileArgs(level, log2file_location, __VA_ARGS__);                                          \
+			}                                                                                                  \
+		}                                                                                                    \
+	} while (0)
+
+/**
+ * @brief 参数的类型，编码后的参数是类型(1字节)加上值，
+ * 整数与浮点数为8字节(本机字节序)，字符串为4字节的长度加上内容
+ */
+enum class LOG_ARG : uint8_t {
+	INT		 = 'i',
+	UINT	 = 'u',
+	DOUBLE = 'd',
+	STRING = 's'
+};
+
+inline void LogEncodeArg(std::string& out, LOG_ARG type, const void* data, std::size_t size) {
+	out += static_cast<char>(type);
+	out.append(static_cast<const char*>(data), size);
+}
+
+inline void LogEncodeString(std::string& out, const char* data, std::size_t size) {
+	auto length = static_cast<uint32_t>(size);
+	LogEncodeArg(out, LOG_ARG::STRING, &length, sizeof(length));
+	out.append(data, length);
+}
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type LogEncodeArg(std::string& out, T value) {
+	auto v = static_cast<int64_t>(value);
+	LogEncodeArg(out, LOG_ARG::INT, &v, sizeof(v));
+}
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type LogEncodeArg(std::string& out, T value) {
+	auto v = static_cast<uint64_t>(value);
+	LogEncodeArg(out, LOG_ARG::UINT, &v, sizeof(v));
+}
+
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type LogEncodeArg(std::string& out, T value) {
+	auto v = static_cast<double>(value);
+	LogEncodeArg(out, LOG_ARG::DOUBLE, &v, sizeof(v));
+}
+
+inline void LogEncodeArg(std::string& out, char value) {
+	LogEncodeString(out, &value, 1);
+}
+
+inline void LogEncodeArg(std::string& out, const char* value) {
+	LogEncodeString(out, value, std::strlen(value));
+}
+
+/**
+ * @brief 有data()与size()的字符串(std::string、work::StringSpan)，只拷贝内容
+ */
+template<typename T>
+auto LogEncodeArg(std::string& out, const T& value) -> decltype(value.data(), value.size(), void()) {
+	LogEncodeString(out, value.data(), value.size());
+}
+
+inline void LogEncodeArgs(std::string&) {}
+
+template<typename T, typename... Args>
+void LogEncodeArgs(std::string& out, const T& value, const Args&... args) {
+	LogEncodeArg(out, value);
+	LogEncodeArgs(out, args...);
+}
 
 /**
  * @brief 输出日志信息
+ * 日志先放入当前线程的缓冲区，由后台线程按照调用的顺序批量写入文件，程序退出时写出所有剩下的日志
  * @param level 日志级别
- * @param where 日志来源位置
+ * @param where 日志来源位置，需要在整个程序运行期间有效
  * @param what 详细信息
  */
-void LogToFile(LOG_LEVEL level, const std::string& where, const std::string& what);
+void		 LogToFile(LOG_LEVEL level, const LogLocation& where, std::string what);
+
+/**
+ * @brief 按照格式输出日志，只编码参数，不进行格式化
+ * @param level 日志级别
+ * @param where 日志来源位置，format不为nullptr，需要在整个程序运行期间有效
+ * @param args 所有参数
+ */
+template<typename... Args>
+void LogToFileArgs(LOG_LEVEL level, const LogLocation& where, const Args&... args) {
+	std::string what;
+	LogEncodeArgs(what, args...);
+	LogToFile(level, where, std::move(what));
+}
+
+/**
+ * @brief 把一条日志格式化为一行文本，文本日志与log_decoder共用
+ * @param out 输出追加到这里
+ * @param level 日志级别
+ * @param where 日志来源位置，format不为nullptr时what是编码后的参数
+ * @param what 详细信息
+ */
+void		 FormatLogLine(std::string& out, LOG_LEVEL level, const LogLocation& where, const std::string& what);
+
+/**
+ * @brief 设置日志的选项，缓冲区大小只对之后第一次输出日志的线程有效
+ * @param option 选项
+ */
+void		 SetLogOption(const LogOption& option);
+
+/**
+ * @brief 等待已经输出的日志全部写入文件
+ */
+void		 FlushLog();
+
+/**
+ * @brief 获取因为缓冲区满而丢弃的日志条数
+ * @return 条数
+ */
+uint64_t GetDroppedLogCount();
+
+/**
+ * @brief 获取因为限流而抑制的日志条数
+ * @return 条数
+ */
+uint64_t GetSuppressedLogCount();
 
 #endif//ERROR_LOGGER_HPP
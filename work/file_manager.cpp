@@ -1,9 +1,27 @@
 #include "file_manager.hpp"
 
 #include <boost/filesystem.hpp>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "data_form.hpp"
+#include "delimiter_scanner.hpp"
 #include "error_logger.hpp"
+#include "file_reader.hpp"
+#include "line_tokenizer.hpp"
+#include "number_parser.hpp"
+#include "source_plan.hpp"
+#include "thread_manager.hpp"
 
 namespace {
 	/**
@@ -29,83 +47,441 @@ namespace {
 	}
 
 	/**
-	 * @brief 判断一个字符串是否有期待的长度
-	 * @param line 字符串
-	 * @param element_num 期待的元素个数
-	 * @param delimiter 分隔符
-	 * @return 是否有期待长度
-	 */
-	bool DoLineLengthValidate(const std::string& line, std::string::size_type element_num, char delimiter) {
-		// 长度应该至少有 （index + 1) * 2 - 1 这么多个 delimiter(char) 那么长
-		if (line.length() < ((element_num + 1) * 2 - 1) * sizeof(char) || std::count(line.cbegin(), line.cend(), delimiter) < element_num) {
-			LOG2FILE(LOG_LEVEL::ERROR, "Insufficient length: " + line);
-			return false;
-		}
-		return true;
-	}
-
-	/**
-	 * @brief 获取字符串某一列的子字符串
-	 * @param line 字符串
+	 * @brief 获取切分好的行中某一列的内容
+	 * @param tokenizer 已经切分好的行
 	 * @param which_column 某一列
-	 * @param delimiter 分隔符
-	 * @return 子字符串，如果长度不够返回空串
+	 * @return 该列的视图，如果长度不够返回空视图
 	 */
-	std::string DoGetSubstr(const std::string& line, std::string::size_type which_column, char delimiter) {
-		if (!DoLineLengthValidate(line, which_column, delimiter)) {
+	work::StringSpan DoGetColumn(const work::LineTokenizer& tokenizer, work::LineTokenizer::size_type which_column) {
+		if (!tokenizer.HasColumn(which_column)) {
+			LOG2FILE_ARGS(LOG_LEVEL::ERROR, "Insufficient length: {}", tokenizer.GetLine());
 			return {};
 		}
-		decltype(which_column) it = 0;
-		for (decltype(which_column) this_column = 0; this_column < which_column; ++this_column) {
-			// 加上 sizeof(delimiter)的偏移以跳过这个delimiter
-			it = line.find(delimiter, it) + sizeof(delimiter);
-		}
-		decltype(it) next = line.find(delimiter, it);
-		return line.substr(it, next - it);
+		return tokenizer.GetColumn(which_column);
 	}
 
 	/**
-	 * @brief 判断字符串是否符合所有代码
+	 * @brief 判断切分好的行是否符合所有代码
 	 * @param code 代码集合
-	 * @param line 字符串
-	 * @param delimiter 分隔符
+	 * @param tokenizer 已经切分好的行
 	 * @return 是否符合
 	 */
-	bool DoValidCode(const std::unordered_map<std::string, work::data::DataSourceCodeDetail>& code, const std::string& line, char delimiter) {
-		return std::all_of(code.cbegin(), code.cend(), [delimiter, &line](const std::pair<std::string, work::data::DataSourceCodeDetail>& name_code) {
-			auto code_str = DoGetSubstr(line, name_code.second.column, delimiter);
+	bool DoValidCode(const std::vector<work::data::SourcePlan::CodeSlot>& code, const work::LineTokenizer& tokenizer) {
+		return std::all_of(code.cbegin(), code.cend(), [&tokenizer](const work::data::SourcePlan::CodeSlot& slot) {
+			auto code_str = DoGetColumn(tokenizer, slot.column);
 			if (code_str.empty()) {
-				LOG2FILE(LOG_LEVEL::ERROR, "Valid code error, cannot get str of " + name_code.first + "'s column " + std::to_string(name_code.second.column));
+				LOG2FILE_ARGS(LOG_LEVEL::ERROR, "Valid code error, cannot get str of {}'s column {}", slot.name, slot.column);
 				// todo: 如果给定的`列`不合法应该直接结束判断还是跳过这个判断？
 				return false;
 			}
 
-			return name_code.second.Accept(stoull(code_str, nullptr));
+			work::data::DataSourceCodeDetail::value_type value;
+			if (!work::ParseUnsigned(code_str, value)) {
+				LOG2FILE_ARGS(LOG_LEVEL::ERROR, "Valid code error, invalid number {} of {} in {}", code_str, slot.name, tokenizer.GetLine());
+				return false;
+			}
+
+			return slot.filter.Accept(value);
 		});
 	}
 
 	/**
-	 * @brief 获取符合条件的所有文件名字(绝对路径)
-	 * @tparam Iterator 迭代器的类型(拥用于支持递归)
-	 * @param out 输出所有文件名字
-	 * @param pred 条件判断
-	 * @param begin 起始迭代器
-	 * @param end 终止迭代器
+	 * @brief 解析已经切分好的一行并累计到结果中
+	 * @param plan 解析计划
+	 * @param name 文件的类型
+	 * @param tokenizer 已经切分好的行
+	 * @param ret 累计的结果，类型的顺序与解析计划一致
 	 */
-	template<typename Iterator>
-	void DoFind(std::vector<std::string>& out, const std::function<bool(const std::string&)>& pred, Iterator begin, Iterator end = {}) {
-		for (; begin != end; ++begin) {
-			auto p		 = begin->path();
-			auto abs_p = absolute(p).string();
-
-			if (pred(p.filename().string())) {
-				out.push_back(abs_p);
-			} else {
+	void DoParseLine(
+			const work::data::SourcePlan& plan,
+			work::data::FILE_TYPE					name,
+			const work::LineTokenizer&		tokenizer,
+			work::data::FileDataType&			ret) {
+		// validate code
+		if (!DoValidCode(plan.code, tokenizer)) {
+			return;
+		}
+
+		work::data::DataSourceFieldDetail::value_type price = 0;
+		work::data::DataSourceFieldDetail::size_type	layer;
+
+		if (plan.price_column != work::data::SourcePlan::npos) {
+			auto price_str = DoGetColumn(tokenizer, plan.price_column);
+			if (price_str.empty()) {
+				LOG2FILE_ARGS(LOG_LEVEL::ERROR, "Invalid str {} of price in {}", price_str, tokenizer.GetLine());
+			} else if (!work::ParseUnsigned(price_str, price)) {
+				LOG2FILE_ARGS(LOG_LEVEL::ERROR, "Invalid price {} in {}", price_str, tokenizer.GetLine());
+				return;
+			}
+		}
+
+		auto																					layer_str = DoGetColumn(tokenizer, plan.layer_column);
+		work::data::DataSourceFieldDetail::value_type layer_value;
+		if (!work::ParseUnsigned(layer_str, layer_value)) {
+			LOG2FILE_ARGS(LOG_LEVEL::ERROR, "Invalid layer {} in {}", layer_str, tokenizer.GetLine());
+			return;
+		}
+		layer = static_cast<work::data::DataSourceFieldDetail::size_type>(layer_value);
+
+		// 字段的下标与结果中的下标一一对应
+		for (decltype(plan.field.size()) i = 0; i < plan.field.size(); ++i) {
+			const auto& slot = plan.field[i];
+			auto&				data = ret[i].data[DoGetColumn(tokenizer, slot.column).ToString()];
+			data.Increase(layer, name, price);
+			if (slot.pad && !data.pad_json) {
+				data.pad_json = plan.pad_json;
+			}
+		}
+	}
+
+	/**
+	 * @brief 解析一块完整的行并累计到结果中
+	 * @param plan 解析计划
+	 * @param name 文件的类型
+	 * @param block 要解析的块，只包含完整的行
+	 * @param scanner 用于扫描分隔符以及换行符的扫描器
+	 * @param tokenizer 用于切分行的切分器
+	 * @param ret 累计的结果
+	 */
+	void DoParseBlock(
+			const work::data::SourcePlan&			 plan,
+			work::data::FILE_TYPE										 name,
+			work::StringSpan												 block,
+			work::DelimiterScanner&									 scanner,
+			work::LineTokenizer&										 tokenizer,
+			work::data::FileDataType&								 ret) {
+		using size_type										 = work::DelimiterScanner::size_type;
+		constexpr static size_type window_size = work::DelimiterScanner::recommended_size;
+
+		while (!block.empty()) {
+			// 按换行符对齐将块分为若干个窗口，保证位置数组留在缓存中
+			auto size = block.size();
+			if (size > window_size) {
+				const auto* last = static_cast<const char*>(memrchr(block.data(), work::DelimiterScanner::newline, window_size));
+				if (last == nullptr) {
+					// 一行比窗口还长
+					last = static_cast<const char*>(std::memchr(block.data() + window_size, work::DelimiterScanner::newline, size - window_size));
+				}
+				if (last != nullptr) {
+					size = static_cast<size_type>(last - block.data()) + 1;
+				}
+			}
+
+			auto window = block.SubSpan(0, size);
+			block				= block.SubSpan(size);
+
+			auto				count				= scanner.Scan(window);
+			const auto* positions		= scanner.GetPositions();
+			size_type		line_offset = 0;
+			size_type		first				= 0;
+			for (size_type i = 0; i < count; ++i) {
+				if (window[positions[i]] != work::DelimiterScanner::newline) {
+					continue;
+				}
+				tokenizer.Assign(window.SubSpan(line_offset, positions[i] - line_offset), positions + first, i - first, line_offset, plan.max_column);
+				DoParseLine(plan, name, tokenizer, ret);
+				line_offset = positions[i] + 1;
+				first				= i + 1;
+			}
+
+			// 文件末尾没有换行符的行
+			if (line_offset < window.size()) {
+				tokenizer.Assign(window.SubSpan(line_offset), positions + first, count - first, line_offset, plan.max_column);
+				DoParseLine(plan, name, tokenizer, ret);
+			}
+		}
+	}
+
+	/**
+	 * @brief 按换行符对齐将一块完整的行尽量均匀地分为若干份
+	 * @param block 要切分的块
+	 * @param count 期望的份数
+	 * @return 切分的结果，块太小时份数可能少于期望的份数
+	 */
+	std::vector<work::StringSpan> DoSplitBlock(work::StringSpan block, work::StringSpan::size_type count) {
+		using size_type = work::StringSpan::size_type;
+
+		std::vector<work::StringSpan> ret;
+		ret.reserve(count);
+
+		while (!block.empty()) {
+			auto remain_count = count - ret.size();
+			auto size					= block.size() / (remain_count == 0 ? 1 : remain_count);
+			if (remain_count <= 1 || size == 0 || size >= block.size()) {
+				ret.push_back(block);
+				break;
+			}
+
+			// 延伸到这一行的结尾
+			const auto* end = static_cast<const char*>(std::memchr(block.data() + size, work::DelimiterScanner::newline, block.size() - size));
+			size						= end == nullptr ? block.size() : static_cast<size_type>(end - block.data()) + 1;
+			ret.push_back(block.SubSpan(0, size));
+			block = block.SubSpan(size);
+		}
+		return ret;
+	}
+
+	/**
+	 * @brief 将部分结果合并到结果中，两者的类型顺序必须一致(都来自DoMakeEmptyData)
+	 * @param to 合并到的结果
+	 * @param from 部分结果
+	 */
+	void DoMergeData(work::data::FileDataType& to, const work::data::FileDataType& from) {
+		for (decltype(to.size()) i = 0; i < to.size(); ++i) {
+			auto& data = to[i].data;
+			if (data.empty() && !from[i].data.empty()) {
+				data = from[i].data;
 				continue;
 			}
+			for (const auto& kv: from[i].data) {
+				data[kv.first].Merge(kv.second);
+			}
+		}
+	}
+
+	/**
+	 * @brief 将一块完整的行按换行符对齐切分之后并行解析，每个线程解析到自己的部分结果中，最后合并
+	 * 合并的结果与串行解析的结果完全一致
+	 * @param plan 解析计划
+	 * @param name 文件的类型
+	 * @param block 要解析的块，只包含完整的行
+	 * @param delimiter 分隔符
+	 * @param scanner 当前线程使用的扫描器
+	 * @param tokenizer 当前线程使用的切分器
+	 * @param ret 累计的结果
+	 * @param thread 用于并行解析的线程池
+	 */
+	void DoParseBlockParallel(
+			const work::data::SourcePlan&			 plan,
+			work::data::FILE_TYPE										 name,
+			work::StringSpan												 block,
+			char																		 delimiter,
+			work::DelimiterScanner&									 scanner,
+			work::LineTokenizer&										 tokenizer,
+			work::data::FileDataType&								 ret,
+			work::ThreadManager&										 thread) {
+		// 每个线程至少解析这么多数据，否则切分与合并的开销得不偿失
+		constexpr static work::StringSpan::size_type min_chunk_size = 4 << 20;
+
+		auto																				 max_count			= block.size() / min_chunk_size;
+		auto																				 chunks					= DoSplitBlock(block, std::max<decltype(max_count)>(1, std::min(plan.parse_thread, max_count)));
+		if (chunks.size() <= 1) {
+			DoParseBlock(plan, name, block, scanner, tokenizer, ret);
+			return;
+		}
+
+		std::vector<work::data::FileDataType> partials(chunks.size() - 1, plan.MakeEmptyData());
+		work::ThreadManager::TaskGroup				 group{thread};
+		std::vector<std::future<void>>				 futures;
+		// 任务引用了栈上的chunks与partials，即使抛出异常也要等所有已经提交的任务结束之后才能离开
+		std::exception_ptr										 error;
+		try {
+			for (decltype(chunks.size()) i = 1; i < chunks.size(); ++i) {
+				futures.push_back(group.Submit([&plan, name, delimiter, &chunks, &partials, i]() {
+					work::DelimiterScanner chunk_scanner{delimiter};
+					work::LineTokenizer		 chunk_tokenizer;
+					DoParseBlock(plan, name, chunks[i], chunk_scanner, chunk_tokenizer, partials[i - 1]);
+				}));
+			}
+			// 第一份直接在当前线程解析到结果中
+			DoParseBlock(plan, name, chunks.front(), scanner, tokenizer, ret);
+		} catch (...) {
+			error = std::current_exception();
+		}
+		// 线程池中没有空闲的线程时剩下的部分也在当前线程解析
+		for (auto& future: futures) {
+			try {
+				group.Wait(future);
+			} catch (...) {
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+
+		for (const auto& partial: partials) {
+			DoMergeData(ret, partial);
+		}
+	}
+
+	/**
+	 * @brief 解析一个已经打开的文件
+	 * @param plan 解析计划
+	 * @param name 文件的类型
+	 * @param file 已经打开的文件
+	 * @param delimiter 分隔符
+	 * @param complete_size 不为空时只解析完整的行(以换行符结尾)，并输出解析的字节数
+	 * @param thread 用于并行解析的线程池，为空时不并行
+	 * @return 解析的数据
+	 */
+	work::data::FileDataType DoParseFile(
+			const work::data::SourcePlan&			 plan,
+			work::data::FILE_TYPE										 name,
+			work::FileReader&												 file,
+			char																		 delimiter,
+			work::FileReader::size_type*						 complete_size,
+			work::ThreadManager*										 thread) {
+		auto									 ret = plan.MakeEmptyData();
+
+		// 一次扫描找出整块中所有分隔符以及换行符的位置，之后每一行只根据这些位置切分
+		work::DelimiterScanner scanner{delimiter};
+		work::LineTokenizer		 tokenizer;
+		work::StringSpan			 block;
+		while (file.NextBlock(block)) {
+			bool last_block = false;
+			if (complete_size != nullptr && block[block.size() - 1] != work::DelimiterScanner::newline) {
+				// 最后一行还没有写完，留到下一次解析
+				const auto* last = static_cast<const char*>(memrchr(block.data(), work::DelimiterScanner::newline, block.size()));
+				block						 = block.SubSpan(0, last == nullptr ? 0 : static_cast<work::StringSpan::size_type>(last - block.data()) + 1);
+				last_block			 = true;
+			}
+
+			// 只有映射的文件才是一整块，可以切分后并行解析
+			if (file.IsMapped() && plan.parse_thread > 1 && thread != nullptr) {
+				DoParseBlockParallel(plan, name, block, delimiter, scanner, tokenizer, ret, *thread);
+			} else {
+				DoParseBlock(plan, name, block, scanner, tokenizer, ret);
+			}
 
-			LOG2FILE(LOG_LEVEL::INFO, "Found file: " + abs_p);
+			if (complete_size != nullptr) {
+				*complete_size += block.size();
+			}
+			if (last_block) {
+				break;
+			}
 		}
+
+		return ret;
+	}
+
+	/**
+	 * @brief getdents64返回的目录项，d_name以'\0'结尾，实际长度由d_reclen决定
+	 */
+	struct DirEntry64 {
+		uint64_t			 d_ino;
+		int64_t				 d_off;
+		unsigned short d_reclen;
+		unsigned char	 d_type;
+		char					 d_name[1];
+	};
+
+	// 一次读取目录项的缓冲区大小
+	constexpr std::size_t dirent_buffer_size = 1 << 16;
+
+	/**
+	 * @brief 搜索文件时等待搜索的一个文件夹
+	 */
+	struct ScanDirectory {
+		// 所属请求的下标
+		std::size_t request;
+		// 文件夹的绝对路径
+		std::string path;
+	};
+
+	/**
+	 * @brief 拼接文件夹与其中的名字
+	 * @param dir 文件夹
+	 * @param name 名字
+	 * @return 拼接的路径
+	 */
+	std::string DoJoinPath(const std::string& dir, const std::string& name) {
+		std::string ret;
+		ret.reserve(dir.size() + 1 + name.size());
+		ret.append(dir);
+		if (ret.empty() || ret.back() != '/') {
+			ret.push_back('/');
+		}
+		ret.append(name);
+		return ret;
+	}
+
+	/**
+	 * @brief 使用getdents64搜索一个文件夹(不递归)，只有d_type无法确定类型时才调用fstatat
+	 * 先用文件名判断，通过判断之后才构建路径
+	 * @param request 请求
+	 * @param dir 文件夹的绝对路径
+	 * @param buffer 读取目录项的缓冲区
+	 * @param files 输出通过判断的文件
+	 * @param dirs 输出子文件夹，只在递归时输出
+	 */
+	void DoScanDirectory(
+			const work::FileManager::ScanRequest& request,
+			const std::string&										dir,
+			std::vector<char>&										buffer,
+			std::vector<std::string>&							files,
+			std::vector<std::string>&							dirs) {
+		int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd < 0) {
+			LOG2FILE(LOG_LEVEL::ERROR, "Cannot open directory: " + dir + " (" + std::strerror(errno) + ")");
+			return;
+		}
+
+		// 重复使用同一个字符串，避免每个目录项都分配内存
+		std::string name;
+		for (;;) {
+			auto size = ::syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+			if (size < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				LOG2FILE(LOG_LEVEL::ERROR, "Cannot read directory: " + dir + " (" + std::strerror(errno) + ")");
+				break;
+			}
+			if (size == 0) {
+				break;
+			}
+
+			for (long offset = 0; offset < size;) {
+				const auto* entry = reinterpret_cast<const DirEntry64*>(buffer.data() + offset);
+				offset += entry->d_reclen;
+
+				const char* entry_name = entry->d_name;
+				if (entry_name[0] == '.' && (entry_name[1] == '\0' || (entry_name[1] == '.' && entry_name[2] == '\0'))) {
+					continue;
+				}
+
+				auto type = entry->d_type;
+				if (type == DT_UNKNOWN) {
+					// 部分文件系统不提供类型
+					struct stat st {};
+					if (::fstatat(fd, entry_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+						continue;
+					}
+					type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG
+																																	: S_ISLNK(st.st_mode) ? DT_LNK
+																																												: DT_UNKNOWN;
+				}
+
+				if (type == DT_DIR) {
+					if (request.recursive) {
+						name.assign(entry_name);
+						dirs.push_back(DoJoinPath(dir, name));
+					}
+					continue;
+				}
+				if (type != DT_REG && type != DT_LNK) {
+					continue;
+				}
+
+				name.assign(entry_name);
+				if (request.pred && !request.pred(name)) {
+					continue;
+				}
+				if (type == DT_LNK) {
+					// 只接受指向普通文件的符号链接
+					struct stat st {};
+					if (::fstatat(fd, entry_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+						continue;
+					}
+				}
+				files.push_back(DoJoinPath(dir, name));
+			}
+		}
+
+		::close(fd);
 	}
 }// namespace
 
@@ -121,63 +497,55 @@ namespace work {
 		return json.get<data::DataConfigManager>();
 	}
 
-	data::FileDataType FileManager::LoadFile(const data::DataSourceFieldDetail& detail, data::FILE_TYPE name, const std::string& filename, char delimiter) {
-		std::ifstream file;
-		if (!DoFileValidate(filename, file)) {
+	data::FileDataType FileManager::LoadFile(const data::SourcePlan& plan, data::FILE_TYPE name, const std::string& filename, char delimiter, ThreadManager* thread) {
+		if (filename.empty()) {
+			LOG2FILE(LOG_LEVEL::ERROR, "Empty filename");
 			return {};
 		}
 
-		//		LOG2FILE(LOG_LEVEL::INFO, "Logging for " + nlohmann::json{detail}.dump());
-
-		data::FileDataType ret{};
-
-		ret.reserve(detail.field.size());
-		for (const auto& kv: detail.field) {
-			// 只设置类型
-			ret.push_back({kv.first});
+		// 优先映射整个文件，每一行都直接引用映射的内存而不是拷贝到std::string
+		FileReader file{filename};
+		if (!file.IsOpen()) {
+			LOG2FILE(LOG_LEVEL::ERROR, "Cannot open file: " + filename);
+			return {};
 		}
 
-		std::string entire_line;
-		while (std::getline(file, entire_line)) {
-			// validate code
-			if (!DoValidCode(detail.code, entire_line, delimiter)) {
-				continue;
-			}
+		//		LOG2FILE(LOG_LEVEL::INFO, "Logging for " + nlohmann::json{detail}.dump());
 
-			data::DataSourceFieldDetail::value_type price = 0;
-			data::DataSourceFieldDetail::size_type	layer;
+		return DoParseFile(plan, name, file, delimiter, nullptr, thread);
+	}
 
-			{
-				auto it = detail.code.find("price");
-				if (it != detail.code.end()) {
-					auto price_str = DoGetSubstr(entire_line, it->second.column, delimiter);
-					if (price_str.empty()) {
-						LOG2FILE(LOG_LEVEL::ERROR, std::string{"Invalid str "}.append(price_str).append(" of ").append(it->first).append(" in ").append(entire_line));
-					} else {
-						price = stoull(price_str, nullptr);
-					}
-				}
-			}
+	data::FileDataType FileManager::LoadAppendedFile(
+			const data::SourcePlan& plan,
+			data::FILE_TYPE					name,
+			const std::string&			filename,
+			TailPosition&						position,
+			char															 delimiter,
+			ThreadManager*										 thread) {
+		if (filename.empty()) {
+			LOG2FILE(LOG_LEVEL::ERROR, "Empty filename");
+			return {};
+		}
 
-			auto layer_str = DoGetSubstr(entire_line, detail.layer, delimiter);
-			if (layer_str.empty()) {
-				LOG2FILE(LOG_LEVEL::ERROR, std::string{"Invalid layer "}.append(layer_str).append(" in ").append(entire_line));
-				continue;
-			} else {
-				layer = static_cast<data::DataSourceFieldDetail::size_type>(stoull(layer_str, nullptr));
-			}
+		std::unique_ptr<FileReader> file{new FileReader{filename, static_cast<FileReader::size_type>(position.offset)}};
+		if (!file->IsOpen()) {
+			LOG2FILE(LOG_LEVEL::ERROR, "Cannot open file: " + filename);
+			return {};
+		}
 
-			for (const auto& kv: detail.field) {
-				auto	id	 = DoGetSubstr(entire_line, kv.second, delimiter);
-				auto& type = kv.first;
-				auto	it	 = std::find_if(ret.begin(), ret.end(), [&type](const data::DataWithType& data) { return data.type == type; });
-				it->data[id].Increase(layer, name, price);
-				if (std::find(detail.pad_field_name.cbegin(), detail.pad_field_name.cend(), kv.first) != detail.pad_field_name.cend()) {
-					it->data[id].pad_json = nlohmann::json::parse(detail.pad_data);
-				}
+		// 文件被替换或者被截断，从头开始解析(截断后的大小不超过原来的位置时不会映射，所以只看是否是普通文件)
+		if (file->GetInode() != position.inode || (file->IsRegularFile() && file->GetFileSize() < position.offset)) {
+			if (position.offset != 0) {
+				LOG2FILE(LOG_LEVEL::WARNING, "File replaced or truncated, parse from beginning: " + filename);
+				file.reset(new FileReader{filename});
 			}
+			position.inode	= file->GetInode();
+			position.offset = 0;
 		}
 
+		FileReader::size_type complete_size = 0;
+		auto									ret						= DoParseFile(plan, name, *file, delimiter, &complete_size, thread);
+		position.offset += complete_size;
 		return ret;
 	}
 
@@ -185,27 +553,91 @@ namespace work {
 			const std::string&														 path,
 			bool																					 recursive,
 			const std::function<bool(const std::string&)>& pred) {
-		if (!path.empty()) {
-			namespace fs = boost::filesystem;
+		return std::move(GetFilesInPaths({{path, recursive, pred}}).front());
+	}
 
-			fs::path dir_path{path};
-			if (!is_directory(dir_path)) {
-				LOG2FILE(LOG_LEVEL::ERROR, "Path is not a directory: " + path);
-				return {};
+	std::vector<std::vector<std::string>> FileManager::GetFilesInPaths(const std::vector<ScanRequest>& requests, ThreadManager* thread) {
+		std::vector<std::vector<std::string>> ret(requests.size());
+
+		// 等待搜索的文件夹，递归时子文件夹也放在这里，由空闲的线程取走
+		std::deque<ScanDirectory> pending;
+		bool											recursive = false;
+		for (std::size_t i = 0; i < requests.size(); ++i) {
+			const auto& path = requests[i].path;
+			if (path.empty()) {
+				LOG2FILE(LOG_LEVEL::ERROR, "Empty path");
+				continue;
 			}
 
-			std::vector<std::string> ret{};
-			if (recursive) {
-				DoFind(ret, pred, fs::recursive_directory_iterator{dir_path});
-			} else {
-				DoFind(ret, pred, fs::directory_iterator{dir_path});
+			struct stat st {};
+			if (::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+				LOG2FILE(LOG_LEVEL::ERROR, "Path is not a directory: " + path);
+				continue;
 			}
 
+			pending.push_back({i, GetAbsolutePath(path)});
+			recursive = recursive || requests[i].recursive;
+		}
+		if (pending.empty()) {
 			return ret;
-		} else {
-			LOG2FILE(LOG_LEVEL::ERROR, "Empty path");
-			return {};
 		}
+
+		std::size_t helper_count = thread == nullptr ? 0 : thread->GetThreadCount();
+		if (!recursive) {
+			helper_count = std::min(helper_count, pending.size() - 1);
+		}
+
+		std::mutex							mutex;
+		std::condition_variable cv;
+		// 正在搜索的线程数，为0并且没有等待搜索的文件夹时结束
+		std::size_t							busy = 0;
+
+		auto worker = [&]() {
+			std::vector<char>				 buffer(dirent_buffer_size);
+			std::vector<std::string> files;
+			std::vector<std::string> dirs;
+
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;) {
+				cv.wait(lock, [&] { return !pending.empty() || busy == 0; });
+				if (pending.empty()) {
+					return;
+				}
+
+				auto dir = std::move(pending.front());
+				pending.pop_front();
+				++busy;
+				lock.unlock();
+
+				files.clear();
+				dirs.clear();
+				DoScanDirectory(requests[dir.request], dir.path, buffer, files, dirs);
+
+				lock.lock();
+				--busy;
+				auto& out = ret[dir.request];
+				out.insert(out.end(), std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+				for (auto& sub_dir: dirs) {
+					pending.push_back({dir.request, std::move(sub_dir)});
+				}
+				if (!dirs.empty() || busy == 0) {
+					cv.notify_all();
+				}
+			}
+		};
+
+		std::vector<std::future<void>>									futures;
+		std::unique_ptr<ThreadManager::TaskGroup> group{thread == nullptr ? nullptr : new ThreadManager::TaskGroup{*thread}};
+		for (std::size_t i = 0; i < helper_count; ++i) {
+			futures.push_back(group->Submit(worker));
+		}
+		// 当前线程也参与搜索，线程池中的线程都在忙时由当前线程搜索所有的文件夹
+		worker();
+		for (auto& future: futures) {
+			group->Wait(future);
+		}
+
+		return ret;
 	}
 
 	std::string FileManager::GetFilenameInPath(const std::string& path) {
@@ -1,6 +1,7 @@
 #ifndef FILE_MANAGER_HPP
 #define FILE_MANAGER_HPP
 
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <vector>
@@ -9,8 +10,24 @@
 #include "json_fwd.hpp"
 
 namespace work {
+	class ThreadManager;
+
 	class FileManager {
 	public:
+		/**
+		 * @brief 追加模式下一个文件已经解析到的位置
+		 */
+		struct TailPosition {
+			/**
+			 * @brief 文件的inode，同名文件被替换(例如轮转)时会改变，此时从头开始解析
+			 */
+			uint64_t inode	= 0;
+			/**
+			 * @brief 下一次开始解析的偏移，总是位于一行的开头
+			 */
+			uint64_t offset = 0;
+		};
+
 		/**
 		 * @brief 读取配置文件构建配置管理器
 		 * @param config_path 配置文件路径
@@ -20,31 +37,80 @@ namespace work {
 
 		/**
 		 * @brief 载入并解析一个文件
-		 * @param detail 文件内容解释详情
+		 * @param plan 解析计划(由文件内容解释详情编译得到)
 		 * @param name 文件的类型，支持的类型见`FILE_TYPE GetFileType(const std::string& type)`
 		 * @param filename 文件的名字
 		 * @param delimiter 文件内容的分割符(每一行)
+		 * @param thread 用于并行解析(plan.parse_thread大于1时)的线程池，为空时在当前线程中解析
 		 * @return 解析的文件数据
 		 */
 		static data::FileDataType			 LoadFile(
-						 const data::DataSourceFieldDetail& detail,
-						 data::FILE_TYPE										name,
-						 const std::string&									filename,
-						 char																delimiter = '\t');
+						 const data::SourcePlan& plan,
+						 data::FILE_TYPE				 name,
+						 const std::string&			 filename,
+						 char										 delimiter = '\t',
+						 ThreadManager*					 thread		 = nullptr);
+
+		/**
+		 * @brief 从上一次解析到的位置开始载入并解析一个文件中新追加的完整的行
+		 * 最后一行如果还没有写完(没有换行符)则留到下一次解析
+		 * @param plan 解析计划(由文件内容解释详情编译得到)
+		 * @param name 文件的类型，支持的类型见`FILE_TYPE GetFileType(const std::string& type)`
+		 * @param filename 文件的名字
+		 * @param position 输入为上一次解析到的位置，输出为这一次解析到的位置，文件被替换或者截断时从头开始解析
+		 * @param delimiter 文件内容的分割符(每一行)
+		 * @param thread 用于并行解析(plan.parse_thread大于1时)的线程池，为空时在当前线程中解析
+		 * @return 新追加的行解析得到的数据(增量)
+		 */
+		static data::FileDataType LoadAppendedFile(
+				const data::SourcePlan& plan,
+				data::FILE_TYPE					name,
+				const std::string&			filename,
+				TailPosition&						position,
+				char															 delimiter = '\t',
+				ThreadManager*										 thread		 = nullptr);
+
+		/**
+		 * @brief 搜索一个路径中文件的请求
+		 */
+		struct ScanRequest {
+			/**
+			 * @brief 路径
+			 */
+			std::string												path;
+			/**
+			 * @brief 是否递归搜索
+			 */
+			bool															recursive;
+			/**
+			 * @brief 用于用户进一步匹配所需要的文件名，可能在多个线程中同时调用
+			 */
+			std::function<bool(const std::string&)> pred;
+		};
 
 		/**
 		 * @brief 获得所给路径中所有的文件
+		 * 只返回普通文件(包括指向普通文件的符号链接)，文件夹不会被返回，递归时不会进入符号链接指向的文件夹
 		 * @param path 路径
 		 * @param recursive 是否递归搜索
 		 * @param pred 用于用户进一步匹配所需要的文件名
 		 * 注意，传递的参数是`完整的文件名`(如果有后缀则包含后缀，即使是递归的也不包含相对目录),
-		 * @return 所有搜寻到的文件名
+		 * 只有通过判断的文件才会构建绝对路径
+		 * @return 所有搜寻到的文件名(绝对路径)，顺序不确定
 		 */
 		static std::vector<std::string> GetFilesInPath(
 				const std::string&														 path,
 				bool																					 recursive = false,
 				const std::function<bool(const std::string&)>& pred			 = [](const std::string&) { return true; });
 
+		/**
+		 * @brief 同时搜索多个路径中的文件，递归搜索时子文件夹也会分给不同的线程
+		 * @param requests 所有请求
+		 * @param thread 用于并行搜索的线程池，当前线程也参与搜索，为空时只在当前线程中搜索
+		 * @return 每个请求搜寻到的文件名(绝对路径)，与请求一一对应
+		 */
+		static std::vector<std::vector<std::string>> GetFilesInPaths(const std::vector<ScanRequest>& requests, ThreadManager* thread = nullptr);
+
 		/**
 		 * @brief 获取目标文件路径的文件名
 		 * @param path 目标的路径
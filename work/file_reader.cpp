@@ -0,0 +1,168 @@
+#include "file_reader.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "error_logger.hpp"
+
+namespace work {
+	FileReader::FileReader(const std::string& filename, size_type offset, size_type buffer_size)
+		: fd_(-1),
+			file_size_(0),
+			regular_(false),
+			inode_(0),
+			offset_(offset),
+			mapped_(nullptr),
+			mapped_size_(0),
+			mapped_consumed_(false),
+			eof_(false),
+			remain_begin_(0),
+			remain_size_(0) {
+		fd_ = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd_ < 0) {
+			return;
+		}
+
+		struct stat st {};
+		if (fstat(fd_, &st) == 0) {
+			inode_ = static_cast<uint64_t>(st.st_ino);
+		}
+		if (S_ISREG(st.st_mode)) {
+			regular_	 = true;
+			file_size_ = static_cast<size_type>(st.st_size);
+			if (file_size_ <= offset_) {
+				// 没有需要读取的数据(空文件也无法映射)
+				eof_ = true;
+				return;
+			}
+
+			auto* p = mmap(nullptr, static_cast<size_type>(st.st_size), PROT_READ, MAP_PRIVATE, fd_, 0);
+			if (p != MAP_FAILED) {
+				mapped_			 = static_cast<const char*>(p);
+				mapped_size_ = static_cast<size_type>(st.st_size);
+				// 只是建议，失败了也不影响读取
+				madvise(p, mapped_size_, MADV_SEQUENTIAL);
+				return;
+			}
+		}
+
+		LOG2FILE(LOG_LEVEL::WARNING, "Cannot map file, fallback to buffered read: " + filename);
+		buffer_.resize(buffer_size == 0 ? default_buffer_size : buffer_size);
+
+		if (offset_ != 0 && lseek(fd_, static_cast<off_t>(offset_), SEEK_SET) < 0) {
+			// 无法定位的文件(例如管道)只能读取并丢弃前面的数据
+			size_type skipped = 0;
+			while (skipped < offset_) {
+				auto length = read(fd_, buffer_.data(), std::min(buffer_.size(), offset_ - skipped));
+				if (length <= 0) {
+					eof_ = true;
+					break;
+				}
+				skipped += static_cast<size_type>(length);
+			}
+		}
+	}
+
+	FileReader::~FileReader() {
+		if (mapped_) {
+			munmap(const_cast<char*>(mapped_), mapped_size_);
+		}
+		if (fd_ >= 0) {
+			close(fd_);
+		}
+	}
+
+	bool FileReader::NextBlock(StringSpan& block) {
+		if (!IsOpen()) {
+			return false;
+		}
+
+		if (IsMapped()) {
+			if (mapped_consumed_) {
+				return false;
+			}
+			mapped_consumed_ = true;
+			block						 = {mapped_ + offset_, mapped_size_ - offset_};
+			return true;
+		}
+
+		return DoReadBlock(block);
+	}
+
+	bool FileReader::NextLine(StringSpan& line) {
+		while (current_block_.empty()) {
+			if (!NextBlock(current_block_)) {
+				return false;
+			}
+		}
+
+		const auto* begin = current_block_.data();
+		const auto* next	= static_cast<const char*>(std::memchr(begin, '\n', current_block_.size()));
+		if (next == nullptr) {
+			// 文件末尾没有换行符的行
+			line					 = current_block_;
+			current_block_ = {};
+		} else {
+			auto length		 = static_cast<size_type>(next - begin);
+			line					 = {begin, length};
+			current_block_ = current_block_.SubSpan(length + 1);
+		}
+		return true;
+	}
+
+	bool FileReader::DoReadBlock(StringSpan& block) {
+		// 将上一次残留的不完整行移动到缓冲区开头
+		if (remain_size_ != 0 && remain_begin_ != 0) {
+			std::memmove(buffer_.data(), buffer_.data() + remain_begin_, remain_size_);
+		}
+		remain_begin_ = 0;
+
+		while (!eof_) {
+			if (remain_size_ == buffer_.size()) {
+				// 一行比整个缓冲区还长
+				buffer_.resize(buffer_.size() * 2);
+			}
+
+			auto length = read(fd_, buffer_.data() + remain_size_, buffer_.size() - remain_size_);
+			if (length < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				LOG2FILE(LOG_LEVEL::ERROR, "Read file failed, errno: " + std::to_string(errno));
+				eof_ = true;
+				break;
+			}
+			if (length == 0) {
+				eof_ = true;
+				break;
+			}
+
+			auto old_size = remain_size_;
+			remain_size_ += static_cast<size_type>(length);
+
+			// 只需要在新读入的部分中寻找最后一个换行符
+			const auto* last = static_cast<const char*>(memrchr(buffer_.data() + old_size, '\n', static_cast<size_type>(length)));
+			if (last != nullptr) {
+				auto block_size = static_cast<size_type>(last - buffer_.data()) + 1;
+				block						= {buffer_.data(), block_size};
+				remain_begin_		= block_size;
+				remain_size_ -= block_size;
+				return true;
+			}
+		}
+
+		// 文件结尾，返回剩下的所有数据
+		if (remain_size_ == 0) {
+			return false;
+		}
+		block				 = {buffer_.data(), remain_size_};
+		remain_size_ = 0;
+		return true;
+	}
+}// namespace work
@@ -0,0 +1,119 @@
+#ifndef FILE_READER_HPP
+#define FILE_READER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "string_span.hpp"
+
+namespace work {
+	/**
+	 * @brief 按行读取文件，优先使用mmap映射整个文件以避免拷贝
+	 * 无法映射的文件(例如管道，部分网络文件系统)回退为带缓冲的read
+	 */
+	class FileReader {
+	public:
+		using size_type																 = StringSpan::size_type;
+
+		/**
+		 * @brief 回退模式下缓冲区的默认大小
+		 */
+		constexpr static size_type default_buffer_size = 1 << 20;
+
+		/**
+		 * @brief 打开一个文件
+		 * @param filename 文件的名字
+		 * @param offset 从文件的哪个位置开始读取，超过文件大小时不会读取到任何数据
+		 * @param buffer_size 回退模式下缓冲区的大小，一行超过缓冲区大小时缓冲区会自动扩大
+		 */
+		explicit FileReader(const std::string& filename, size_type offset = 0, size_type buffer_size = default_buffer_size);
+		~FileReader();
+
+		FileReader(const FileReader&) = delete;
+		FileReader& operator=(const FileReader&) = delete;
+
+		/**
+		 * @brief 文件是否成功打开
+		 * @return 是否成功打开
+		 */
+		bool				IsOpen() const { return fd_ >= 0; }
+
+		/**
+		 * @brief 文件是否被映射
+		 * @return 是否被映射
+		 */
+		bool				IsMapped() const { return mapped_ != nullptr; }
+
+		/**
+		 * @brief 是否是普通文件(可以获取大小)
+		 * @return 是否是普通文件
+		 */
+		bool				IsRegularFile() const { return regular_; }
+
+		/**
+		 * @brief 获取文件打开时的大小(非普通文件为0)
+		 * @return 文件的大小
+		 */
+		size_type		GetFileSize() const { return file_size_; }
+
+		/**
+		 * @brief 获取文件的inode，用于判断同名文件是否被替换
+		 * @return 文件的inode
+		 */
+		uint64_t		GetInode() const { return inode_; }
+
+		/**
+		 * @brief 读取下一块完整的行(包含最后的换行符，文件末尾的行可能没有换行符)
+		 * 映射模式下返回的视图在reader析构之前一直有效，回退模式下只在下一次读取之前有效
+		 * @param block 输出的块
+		 * @return 是否读取到数据
+		 */
+		bool				NextBlock(StringSpan& block);
+
+		/**
+		 * @brief 读取下一行(不包含换行符)，视图的有效期同NextBlock
+		 * @param line 输出的行
+		 * @return 是否读取到数据
+		 */
+		bool				NextLine(StringSpan& line);
+
+	private:
+		/**
+		 * @brief 回退模式下从文件读取下一块完整的行
+		 * @param block 输出的块
+		 * @return 是否读取到数据
+		 */
+		bool				DoReadBlock(StringSpan& block);
+
+		// 文件的file descriptor
+		int								fd_;
+		// 文件打开时的大小
+		size_type					file_size_;
+		// 是否是普通文件
+		bool							regular_;
+		// 文件的inode
+		uint64_t					inode_;
+		// 开始读取的位置
+		size_type					offset_;
+		// 映射的内存，没有映射时为nullptr
+		const char*				mapped_;
+		// 映射的内存(文件)的大小
+		size_type					mapped_size_;
+		// 映射模式下整个文件是否已经作为一个块返回
+		bool							mapped_consumed_;
+		// 文件是否已经读到结尾(回退模式)
+		bool							eof_;
+
+		// 回退模式的缓冲区
+		std::vector<char> buffer_;
+		// 缓冲区中上一个块之后残留的(不完整的行)数据的起始位置以及长度
+		size_type					remain_begin_;
+		size_type					remain_size_;
+
+		// NextLine当前正在遍历的块
+		StringSpan				current_block_;
+	};
+}// namespace work
+
+#endif//FILE_READER_HPP
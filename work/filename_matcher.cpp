@@ -0,0 +1,139 @@
+#include "filename_matcher.hpp"
+
+#include <cctype>
+#include <cstring>
+
+#include "error_logger.hpp"
+
+namespace work {
+	FilenameMatcher::FilenameMatcher(const std::string& pattern)
+		: fast_(false),
+			digit_count_(0) {
+		fast_ = DoCompileFastPath(pattern);
+		// 快速匹配在遇到换行符时会回退到正则表达式，所以总是编译
+		try {
+			regex_.assign(pattern);
+		} catch (const boost::regex_error& e) {
+			LOG2FILE(LOG_LEVEL::ERROR, "Invalid filename_pattern: " + pattern + " (" + e.what() + ")");
+			fast_ = false;
+		}
+	}
+
+	bool FilenameMatcher::Search(const std::string& filename, std::string* capture) const {
+		if (fast_ && filename.find('\n') == std::string::npos) {
+			auto total = prefix_.size() + digit_count_ + suffix_.size();
+			if (filename.size() < total) {
+				return false;
+			}
+
+			// 与regex_search一样返回最左边的匹配
+			for (std::size_t begin = 0; begin + total <= filename.size(); ++begin) {
+				const char* p = filename.data() + begin;
+				if (!DoMatchTokens(prefix_, p)) {
+					continue;
+				}
+				const char* digits = p + prefix_.size();
+				bool				matched = true;
+				for (std::size_t i = 0; i < digit_count_; ++i) {
+					if (digits[i] < '0' || digits[i] > '9') {
+						matched = false;
+						break;
+					}
+				}
+				if (!matched || !DoMatchTokens(suffix_, digits + digit_count_)) {
+					continue;
+				}
+
+				if (capture) {
+					capture->assign(digits, digit_count_);
+				}
+				return true;
+			}
+			return false;
+		}
+
+		if (regex_.empty()) {
+			return false;
+		}
+
+		boost::smatch result;
+		if (!boost::regex_search(filename, result, regex_)) {
+			return false;
+		}
+		if (capture) {
+			*capture = result.size() > 1 ? result[1].str() : std::string{};
+		}
+		return true;
+	}
+
+	bool FilenameMatcher::DoCompileFastPath(const std::string& pattern) {
+		// 只接受 前缀(\d{N})后缀 的形式
+		auto group_begin = pattern.find("(\\d{");
+		if (group_begin == std::string::npos) {
+			return false;
+		}
+		auto group_end = pattern.find("})", group_begin);
+		if (group_end == std::string::npos) {
+			return false;
+		}
+
+		auto count_str = pattern.substr(group_begin + 4, group_end - group_begin - 4);
+		if (count_str.empty() || count_str.size() > 3 || count_str.find_first_not_of("0123456789") != std::string::npos) {
+			return false;
+		}
+		digit_count_ = static_cast<std::size_t>(std::stoul(count_str));
+
+		auto compile = [](const std::string& part, std::vector<Token>& out) -> bool {
+			// 出现这些字符说明不是简单的字面量
+			constexpr static const char* meta = "^$|?*+()[]{}";
+			for (std::size_t i = 0; i < part.size(); ++i) {
+				char c = part[i];
+				if (c == '\\') {
+					if (++i == part.size()) {
+						return false;
+					}
+					char escaped = part[i];
+					if (escaped == 'd') {
+						out.push_back({TOKEN_TYPE::DIGIT, 0});
+					} else if (std::ispunct(static_cast<unsigned char>(escaped))) {
+						// 转义的符号就是它本身
+						out.push_back({TOKEN_TYPE::LITERAL, escaped});
+					} else {
+						// \w \b \s 等等
+						return false;
+					}
+				} else if (c == '.') {
+					out.push_back({TOKEN_TYPE::ANY, 0});
+				} else if (std::strchr(meta, c) != nullptr) {
+					return false;
+				} else {
+					out.push_back({TOKEN_TYPE::LITERAL, c});
+				}
+			}
+			return true;
+		};
+
+		return compile(pattern.substr(0, group_begin), prefix_) && compile(pattern.substr(group_end + 2), suffix_);
+	}
+
+	bool FilenameMatcher::DoMatchTokens(const std::vector<Token>& tokens, const char* p) {
+		for (std::size_t i = 0; i < tokens.size(); ++i) {
+			const auto& token = tokens[i];
+			switch (token.type) {
+				case TOKEN_TYPE::LITERAL:
+					if (p[i] != token.c) {
+						return false;
+					}
+					break;
+				case TOKEN_TYPE::ANY:
+					break;
+				case TOKEN_TYPE::DIGIT:
+					if (p[i] < '0' || p[i] > '9') {
+						return false;
+					}
+					break;
+			}
+		}
+		return true;
+	}
+}// namespace work
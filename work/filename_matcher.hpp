@@ -0,0 +1,74 @@
+#ifndef FILENAME_MATCHER_HPP
+#define FILENAME_MATCHER_HPP
+
+#include <boost/regex.hpp>
+#include <string>
+#include <vector>
+
+namespace work {
+	/**
+	 * @brief 预先编译的文件名匹配器，语义与boost::regex_search一致，构造之后可以在多个线程中共享
+	 * 对于常见的`前缀(\d{N})后缀`形式(前后缀只包含普通字符，`.`以及转义的符号)直接逐字符匹配，不使用正则表达式
+	 */
+	class FilenameMatcher {
+	public:
+		/**
+		 * @brief 编译模式串
+		 * @param pattern 正则表达式模式串，第一个捕获组为时间子串
+		 */
+		explicit FilenameMatcher(const std::string& pattern);
+
+		/**
+		 * @brief 在文件名中搜索模式串
+		 * @param filename 文件名
+		 * @param capture 不为空时输出第一个捕获组的内容
+		 * @return 是否找到
+		 */
+		bool Search(const std::string& filename, std::string* capture = nullptr) const;
+
+		/**
+		 * @brief 是否使用了不依赖正则表达式的快速匹配
+		 * @return 是否使用快速匹配
+		 */
+		bool IsFastPath() const { return fast_; }
+
+	private:
+		enum class TOKEN_TYPE {
+			// 普通字符
+			LITERAL,
+			// `.`，除换行符以外的任意字符
+			ANY,
+			// `\d`，数字
+			DIGIT
+		};
+
+		struct Token {
+			TOKEN_TYPE type;
+			char			 c;
+		};
+
+		/**
+		 * @brief 尝试将模式串解析为快速匹配的形式
+		 * @param pattern 模式串
+		 * @return 是否可以快速匹配
+		 */
+		bool DoCompileFastPath(const std::string& pattern);
+
+		/**
+		 * @brief 在某个位置尝试匹配一组token
+		 * @return 是否匹配
+		 */
+		static bool DoMatchTokens(const std::vector<Token>& tokens, const char* p);
+
+		// 是否使用快速匹配
+		bool							 fast_;
+		// 快速匹配：前缀，捕获组中数字的个数，后缀
+		std::vector<Token> prefix_;
+		std::size_t				 digit_count_;
+		std::vector<Token> suffix_;
+		// 无法快速匹配时使用的正则表达式
+		boost::regex			 regex_;
+	};
+}// namespace work
+
+#endif//FILENAME_MATCHER_HPP
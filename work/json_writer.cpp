@@ -0,0 +1,285 @@
+#include "json_writer.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+	using BasicData = work::data::BasicData;
+
+	/**
+	 * @brief BasicData中固定的字段
+	 */
+	struct FixedField {
+		const char*					 name;
+		BasicData::DataLayer BasicData::*layer;
+	};
+
+	const FixedField fixed_fields[] = {
+			{work::data::wins_name, &BasicData::wins},
+			{work::data::imps_name, &BasicData::imps},
+			{work::data::clks_name, &BasicData::clks},
+			{work::data::cost_name, &BasicData::cost}};
+
+	void DoAppendUnsigned(std::string& out, uint64_t value) {
+		char	buffer[20];
+		char* end = buffer + sizeof(buffer);
+		char* p		= end;
+		do {
+			*--p = static_cast<char>('0' + value % 10);
+			value /= 10;
+		} while (value != 0);
+		out.append(p, end);
+	}
+
+	/**
+	 * @brief 输出转义后带引号的字符串，与nlohmann::json::dump()的转义相同
+	 * 包含非ASCII字符时交给nlohmann::json处理(检查UTF-8是否合法)
+	 */
+	void DoAppendString(std::string& out, const std::string& str) {
+		static const char* hex = "0123456789abcdef";
+		for (auto c: str) {
+			if (static_cast<unsigned char>(c) >= 0x80) {
+				out += nlohmann::json(str).dump();
+				return;
+			}
+		}
+
+		out += '"';
+		for (auto c: str) {
+			switch (c) {
+				case '"':
+					out += "\\\"";
+					break;
+				case '\\':
+					out += "\\\\";
+					break;
+				case '\b':
+					out += "\\b";
+					break;
+				case '\f':
+					out += "\\f";
+					break;
+				case '\n':
+					out += "\\n";
+					break;
+				case '\r':
+					out += "\\r";
+					break;
+				case '\t':
+					out += "\\t";
+					break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						out += "\\u00";
+						out += hex[(c >> 4) & 0xf];
+						out += hex[c & 0xf];
+					} else {
+						out += c;
+					}
+					break;
+			}
+		}
+		out += '"';
+	}
+
+	void DoAppendLayer(std::string& out, const BasicData::DataLayer& layer) {
+		out += '[';
+		for (std::size_t i = 0; i < layer.size(); ++i) {
+			if (i != 0) {
+				out += ',';
+			}
+			DoAppendUnsigned(out, layer[i]);
+		}
+		out += ']';
+	}
+
+	/**
+	 * @brief 获取替换之后的名字
+	 */
+	const std::string& DoRename(const std::unordered_map<std::string, std::string>& keys, const std::string& key) {
+		auto it = keys.find(key);
+		return it == keys.end() ? key : it->second;
+	}
+}// namespace
+
+namespace work {
+	void JsonWriter::Write(const std::string& time, const data::FileDataType& data, const std::vector<Output>& outputs) {
+		// 同一个类型以最后一个为准(与json[type] = data相同)
+		types_.clear();
+		for (const auto& d: data) {
+			types_.push_back(&d);
+		}
+		std::stable_sort(types_.begin(), types_.end(), [](const data::DataWithType* lhs, const data::DataWithType* rhs) {
+			return lhs->type < rhs->type;
+		});
+		// 反向去重，保留的部分在后面
+		types_.erase(types_.begin(), std::unique(types_.rbegin(), types_.rend(), [](const data::DataWithType* lhs, const data::DataWithType* rhs) {
+																	 return lhs->type == rhs->type;
+																 }).base());
+
+		// id不会被替换，所有输出共用排序的结果
+		if (ids_.size() < types_.size()) {
+			ids_.resize(types_.size());
+		}
+		for (std::size_t i = 0; i < types_.size(); ++i) {
+			auto& ids = ids_[i];
+			ids.clear();
+			ids.reserve(types_[i]->data.size());
+			for (const auto& id_data: types_[i]->data) {
+				ids.push_back(&id_data);
+			}
+			std::sort(ids.begin(), ids.end(), [](const IdData* lhs, const IdData* rhs) {
+				return lhs->first < rhs->first;
+			});
+		}
+
+		for (const auto& output: outputs) {
+			auto& remap = DoGetRemap(output.field_replace);
+			auto& out		= *output.out;
+			out.clear();
+			out += '{';
+			DoAppendString(out, time);
+			// 没有数据时json[time]为null
+			if (types_.empty()) {
+				out += ":null}";
+				continue;
+			}
+
+			order_.resize(types_.size());
+			std::iota(order_.begin(), order_.end(), 0);
+			if (!remap.keys.empty()) {
+				std::sort(order_.begin(), order_.end(), [this, &remap](std::size_t lhs, std::size_t rhs) {
+					return DoRename(remap.keys, types_[lhs]->type) < DoRename(remap.keys, types_[rhs]->type);
+				});
+			}
+
+			out += ":{";
+			for (std::size_t i = 0; i < order_.size(); ++i) {
+				if (i != 0) {
+					out += ',';
+				}
+				DoAppendString(out, DoRename(remap.keys, types_[order_[i]]->type));
+				out += ":{";
+				const auto& ids = ids_[order_[i]];
+				for (std::size_t j = 0; j < ids.size(); ++j) {
+					if (j != 0) {
+						out += ',';
+					}
+					DoAppendString(out, ids[j]->first);
+					out += ':';
+					if (output.sum) {
+						DoWriteSum(out, remap, ids[j]->second);
+					} else {
+						DoWriteData(out, remap, ids[j]->second);
+					}
+				}
+				out += '}';
+			}
+			out += "}}";
+		}
+	}
+
+	JsonWriter::Remap& JsonWriter::DoGetRemap(const std::map<std::string, std::string>* field_replace) {
+		auto it = remaps_.find(field_replace);
+		if (it != remaps_.end()) {
+			return it->second;
+		}
+
+		Remap remap;
+		if (field_replace) {
+			remap.keys.insert(field_replace->cbegin(), field_replace->cend());
+		}
+		for (const auto& field: fixed_fields) {
+			RenamedField renamed{DoRename(remap.keys, field.name), {}, field.layer};
+			DoAppendString(renamed.prefix, renamed.name);
+			renamed.prefix += ':';
+			remap.fields.push_back(std::move(renamed));
+		}
+		std::sort(remap.fields.begin(), remap.fields.end(), [](const RenamedField& lhs, const RenamedField& rhs) {
+			return lhs.name < rhs.name;
+		});
+		return remaps_.emplace(field_replace, std::move(remap)).first->second;
+	}
+
+	const JsonWriter::PadCache& JsonWriter::DoGetPad(Remap& remap, const std::shared_ptr<const nlohmann::json>& pad) {
+		auto it = remap.pads.find(pad.get());
+		if (it != remap.pads.end()) {
+			return it->second;
+		}
+
+		PadCache cache{pad, !pad->is_object(), {}};
+		cache.fallback = cache.fallback || std::any_of(std::begin(fixed_fields), std::end(fixed_fields), [&pad](const FixedField& field) {
+											 return pad->contains(field.name);
+										 });
+		if (!cache.fallback) {
+			// 与to_json(BasicData)中的merge_patch相同，值为null的键会被去掉
+			auto patched = nlohmann::json::object();
+			patched.merge_patch(*pad);
+			for (const auto& item: patched.items()) {
+				const auto& name = DoRename(remap.keys, item.key());
+				std::string field;
+				DoAppendString(field, name);
+				field += ':';
+				field += item.value().dump();
+				cache.fields.emplace_back(name, std::move(field));
+			}
+			std::sort(cache.fields.begin(), cache.fields.end());
+		}
+		return remap.pads.emplace(pad.get(), std::move(cache)).first->second;
+	}
+
+	void JsonWriter::DoWriteData(std::string& out, Remap& remap, const data::BasicData& value) {
+		const PadCache* pad = nullptr;
+		if (value.pad_json && !value.pad_json->empty()) {
+			pad = &DoGetPad(remap, value.pad_json);
+			if (pad->fallback) {
+				nlohmann::json json = value;
+				if (json.is_object() && !remap.keys.empty()) {
+					auto renamed = nlohmann::json::object();
+					for (const auto& item: json.items()) {
+						renamed[DoRename(remap.keys, item.key())] = item.value();
+					}
+					json = std::move(renamed);
+				}
+				out += json.dump();
+				return;
+			}
+		}
+
+		// 固定字段与填充字段都已经排序，合并输出
+		static const decltype(pad->fields) no_pad;
+		const auto&												 pad_fields = pad ? pad->fields : no_pad;
+		auto															 fixed_it		= remap.fields.cbegin();
+		auto															 pad_it			= pad_fields.cbegin();
+		bool															 first			= true;
+		out += '{';
+		while (fixed_it != remap.fields.cend() || pad_it != pad_fields.cend()) {
+			if (!first) {
+				out += ',';
+			}
+			first = false;
+			if (pad_it == pad_fields.cend() || (fixed_it != remap.fields.cend() && fixed_it->name < pad_it->first)) {
+				out += fixed_it->prefix;
+				DoAppendLayer(out, value.*fixed_it->layer);
+				++fixed_it;
+			} else {
+				out += pad_it->second;
+				++pad_it;
+			}
+		}
+		out += '}';
+	}
+
+	void JsonWriter::DoWriteSum(std::string& out, const Remap& remap, const data::BasicData& value) {
+		out += '{';
+		for (std::size_t i = 0; i < remap.fields.size(); ++i) {
+			if (i != 0) {
+				out += ',';
+			}
+			out += remap.fields[i].prefix;
+			const auto& layer = value.*remap.fields[i].layer;
+			DoAppendUnsigned(out, std::accumulate(layer.cbegin(), layer.cend(), static_cast<data::BasicData::value_type>(0)));
+		}
+		out += '}';
+	}
+}// namespace work
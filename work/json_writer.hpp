@@ -0,0 +1,120 @@
+#ifndef JSON_WRITER_HPP
+#define JSON_WRITER_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "data_form.hpp"
+
+namespace work {
+	/**
+	 * @brief 直接把解析得到的数据写成json文本，不构造nlohmann::json，
+	 * 输出与nlohmann::json::dump()完全相同(对象的键按字典序排列，没有空白)
+	 * 每个序列化线程使用自己的实例，排序用的数组、替换表与填充数据的缓存可以重复使用
+	 */
+	class JsonWriter {
+	public:
+		/**
+		 * @brief 一种输出
+		 */
+		struct Output {
+			/**
+			 * @brief 是否求和
+			 */
+			bool																			sum;
+			/**
+			 * @brief 字段名的替换表，被替换的字段名 <-> 替换后的字段名，为nullptr时不替换，
+			 * 替换类型名、wins/imps/clks/cost与填充数据的字段名(不替换时间与id)，按照替换后的名字排序，
+			 * 替换后的键不能重复(由Application::Init检查)，
+			 * 替换表在第一次使用时编译并缓存，需要在writer的整个生命周期内有效
+			 */
+			const std::map<std::string, std::string>* field_replace;
+			/**
+			 * @brief 输出(会先清空，保留容量)
+			 */
+			std::string*															out;
+		};
+
+		/**
+		 * @brief 序列化一个文件的数据，同一个类型出现多次时以最后一个为准，每个类型的id只排序一次
+		 * 不替换字段名时，输出与json[time] = data(求和时为GetSumOfFileDataType(data))的dump()相同
+		 * @param time 文件的时间
+		 * @param data 文件的数据
+		 * @param outputs 所有输出
+		 */
+		void Write(const std::string& time, const data::FileDataType& data, const std::vector<Output>& outputs);
+
+	private:
+		using IdData = data::BasicDataWithId::value_type;
+
+		/**
+		 * @brief 一份填充数据(merge_patch到每个BasicData上)预先序列化的结果
+		 */
+		struct PadCache {
+			// 持有填充数据，保证地址不会被重复使用
+			std::shared_ptr<const nlohmann::json>						 owner;
+			// 与固定的字段冲突或者不是对象时，改用nlohmann::json序列化
+			bool																						 fallback;
+			// 替换后的键 <-> 转义后的"键":值，按键排序
+			std::vector<std::pair<std::string, std::string>> fields;
+		};
+
+		/**
+		 * @brief 替换之后的一个固定字段
+		 */
+		struct RenamedField {
+			std::string											 name;
+			// 转义后的"名字":
+			std::string											 prefix;
+			data::BasicData::DataLayer data::BasicData::*layer;
+		};
+
+		/**
+		 * @brief 编译好的替换表
+		 */
+		struct Remap {
+			std::unordered_map<std::string, std::string>				keys;
+			// 替换之后按照名字排序的固定字段
+			std::vector<RenamedField>														fields;
+			std::unordered_map<const nlohmann::json*, PadCache> pads;
+		};
+
+		/**
+		 * @brief 获取编译好的替换表
+		 * @param field_replace 替换表，可以为nullptr
+		 * @return 编译好的替换表
+		 */
+		Remap&																					 DoGetRemap(const std::map<std::string, std::string>* field_replace);
+
+		/**
+		 * @brief 获取填充数据预先序列化(并替换字段名)的结果
+		 * @param remap 替换表
+		 * @param pad 填充数据，不为空
+		 * @return 结果
+		 */
+		const PadCache&																	 DoGetPad(Remap& remap, const std::shared_ptr<const nlohmann::json>& pad);
+
+		/**
+		 * @brief 输出一个BasicData
+		 */
+		void																						 DoWriteData(std::string& out, Remap& remap, const data::BasicData& value);
+
+		/**
+		 * @brief 输出一个BasicData的求和
+		 */
+		void																						 DoWriteSum(std::string& out, const Remap& remap, const data::BasicData& value);
+
+		std::vector<const data::DataWithType*>					 types_;
+		// 替换类型名之后的顺序，types_的下标
+		std::vector<std::size_t>												 order_;
+		// 每个类型排序之后的id，与types_一一对应
+		std::vector<std::vector<const IdData*>>					 ids_;
+		std::unordered_map<const void*, Remap>					 remaps_;
+	};
+}// namespace work
+
+#endif//JSON_WRITER_HPP
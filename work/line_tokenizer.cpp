@@ -0,0 +1,64 @@
+#include "line_tokenizer.hpp"
+
+namespace {
+	/**
+	 * @brief 去掉CRLF换行留下的行尾'\r'，否则最后一列无法解析为数字
+	 */
+	work::StringSpan DoTrimCarriageReturn(work::StringSpan line) {
+		if (!line.empty() && line[line.size() - 1] == '\r') {
+			return line.SubSpan(0, line.size() - 1);
+		}
+		return line;
+	}
+}// namespace
+
+namespace work {
+	void LineTokenizer::Tokenize(StringSpan line, char delimiter, size_type max_column) {
+		line	= DoTrimCarriageReturn(line);
+		line_ = line;
+		columns_.clear();
+
+		const char* begin = line.data();
+		const char* end		= line.data() + line.size();
+		while (true) {
+			const auto* next = static_cast<const char*>(std::memchr(begin, delimiter, static_cast<size_type>(end - begin)));
+			// 没有更多的分隔符或者已经是需要的最后一列，剩余部分不再切分
+			if (next == nullptr || columns_.size() == max_column) {
+				columns_.emplace_back(begin, static_cast<size_type>((next ? next : end) - begin));
+				return;
+			}
+
+			columns_.emplace_back(begin, static_cast<size_type>(next - begin));
+			// 跳过这个delimiter
+			begin = next + 1;
+		}
+	}
+
+	void LineTokenizer::Assign(
+			StringSpan														 line,
+			const DelimiterScanner::position_type* positions,
+			size_type															 count,
+			size_type															 line_offset,
+			size_type															 max_column) {
+		line = DoTrimCarriageReturn(line);
+		// 分隔符本身是'\r'时它已经不在行中
+		while (count > 0 && positions[count - 1] - line_offset >= line.size()) {
+			--count;
+		}
+		line_ = line;
+		columns_.clear();
+
+		size_type begin = 0;
+		for (size_type i = 0; i < count; ++i) {
+			auto next = positions[i] - line_offset;
+			columns_.emplace_back(line.data() + begin, next - begin);
+			if (columns_.size() > max_column) {
+				// 已经得到需要的最后一列
+				return;
+			}
+			// 跳过这个delimiter
+			begin = next + 1;
+		}
+		columns_.emplace_back(line.data() + begin, line.size() - begin);
+	}
+}// namespace work
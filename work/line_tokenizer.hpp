@@ -0,0 +1,75 @@
+#ifndef LINE_TOKENIZER_HPP
+#define LINE_TOKENIZER_HPP
+
+#include <vector>
+
+#include "delimiter_scanner.hpp"
+#include "string_span.hpp"
+
+namespace work {
+	class LineTokenizer {
+	public:
+		using size_type = StringSpan::size_type;
+
+		/**
+		 * @brief 将一行按照分隔符切分为若干列，整行只扫描一次，行尾的'\r'(CRLF换行)不属于最后一列
+		 * @param line 要切分的行(不包含换行符)，切分结果引用该行的内存
+		 * @param delimiter 分隔符
+		 * @param max_column 最多需要的列(包含)，找到该列之后不再继续切分，npos表示切分整行
+		 */
+		void			 Tokenize(StringSpan line, char delimiter, size_type max_column = StringSpan::npos);
+
+		/**
+		 * @brief 使用DelimiterScanner预先扫描得到的分隔符位置切分一行，不再扫描该行，行尾的'\r'(CRLF换行)不属于最后一列
+		 * @param line 要切分的行(不包含换行符)，切分结果引用该行的内存
+		 * @param positions 该行中所有分隔符的位置(升序)，位置相对于扫描的缓冲区
+		 * @param count 分隔符的个数
+		 * @param line_offset 该行在扫描的缓冲区中的偏移
+		 * @param max_column 最多需要的列(包含)，npos表示切分整行
+		 */
+		void			 Assign(
+							 StringSpan														 line,
+							 const DelimiterScanner::position_type* positions,
+							 size_type															 count,
+							 size_type															 line_offset,
+							 size_type															 max_column = StringSpan::npos);
+
+		/**
+		 * @brief 获取切分得到的列数
+		 * @return 列数
+		 */
+		size_type	 GetColumnSize() const { return columns_.size(); }
+
+		/**
+		 * @brief 判断某一列是否存在
+		 * @param column 某一列
+		 * @return 是否存在
+		 */
+		bool			 HasColumn(size_type column) const { return column < columns_.size(); }
+
+		/**
+		 * @brief 获取某一列的内容
+		 * @param column 某一列
+		 * @return 该列的视图，如果该列不存在返回空视图
+		 */
+		StringSpan GetColumn(size_type column) const { return HasColumn(column) ? columns_[column] : StringSpan{}; }
+
+		/**
+		 * @brief 获取当前切分的行
+		 * @return 当前行
+		 */
+		StringSpan GetLine() const { return line_; }
+
+	private:
+		/**
+		 * @brief 当前切分的行
+		 */
+		StringSpan							line_;
+		/**
+		 * @brief 切分的结果，每一列对应一个视图，复用内存避免每行重新分配
+		 */
+		std::vector<StringSpan> columns_;
+	};
+}// namespace work
+
+#endif//LINE_TOKENIZER_HPP
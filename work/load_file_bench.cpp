@@ -0,0 +1,135 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "file_manager.hpp"
+#include "source_plan.hpp"
+#include "thread_manager.hpp"
+
+namespace {
+	/**
+	 * @brief 生成一个按照解析计划可以被解析的日志文件，字段的列为较小范围内的id，layer在范围内，其他列为随机数
+	 * @param plan 解析计划
+	 * @param filename 文件名
+	 * @param lines 行数
+	 * @return 是否成功
+	 */
+	bool DoGenerateFile(const work::data::SourcePlan& plan, const std::string& filename, std::size_t lines) {
+		std::unique_ptr<FILE, int (*)(FILE*)> file(std::fopen(filename.c_str(), "w"), std::fclose);
+		if (!file) {
+			return false;
+		}
+
+		// 与线上的日志相近，总是比需要的列多几列
+		const auto													 columns = plan.max_column + 4;
+		std::mt19937_64											 random(42);
+		std::uniform_int_distribution<uint64_t> value(1, 1000000000);
+		std::uniform_int_distribution<uint64_t> id(1, 5000);
+		std::uniform_int_distribution<uint64_t> layer(0, work::data::BasicData::bound - 1);
+		std::uniform_int_distribution<uint64_t> price(1, 10000);
+
+		std::vector<uint64_t> ranges(columns, 0);
+		for (const auto& field: plan.field) {
+			ranges[field.column] = 1;
+		}
+		ranges[plan.layer_column] = 2;
+		if (plan.price_column != work::data::SourcePlan::npos) {
+			ranges[plan.price_column] = 3;
+		}
+
+		std::string line;
+		for (std::size_t i = 0; i < lines; ++i) {
+			line.clear();
+			for (std::size_t column = 0; column < columns; ++column) {
+				if (column != 0) {
+					line += '\t';
+				}
+				switch (ranges[column]) {
+					case 1:
+						line += std::to_string(id(random));
+						break;
+					case 2:
+						line += std::to_string(layer(random));
+						break;
+					case 3:
+						line += std::to_string(price(random));
+						break;
+					default:
+						line += std::to_string(value(random));
+						break;
+				}
+			}
+			line += '\n';
+			if (std::fwrite(line.data(), 1, line.size(), file.get()) != line.size()) {
+				return false;
+			}
+		}
+		return true;
+	}
+}// namespace
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cerr << "Config file path or source name not given, usage: ./" << argv[0] << " config_path source_name [lines] [rounds]" << std::endl;
+		return -1;
+	}
+
+	auto config = work::FileManager::LoadConfig(argv[1]);
+	auto it			= config.source.find(argv[2]);
+	if (it == config.source.end() || !it->second.plan || it->second.path.empty()) {
+		std::cerr << "Source not found: " << argv[2] << std::endl;
+		return -1;
+	}
+	const auto& plan	 = *it->second.plan;
+	auto				type	 = work::data::GetFileType(it->second.path.cbegin()->second.type);
+	std::size_t lines	 = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1000000;
+	int					rounds = argc > 4 ? std::max(std::atoi(argv[4]), 1) : 3;
+
+	char filename[] = "/tmp/load_file_bench_XXXXXX";
+	auto fd					= mkstemp(filename);
+	if (fd < 0) {
+		std::cerr << "Cannot create temporary file" << std::endl;
+		return -1;
+	}
+	close(fd);
+	if (!DoGenerateFile(plan, filename, lines)) {
+		std::cerr << "Cannot write temporary file: " << filename << std::endl;
+		unlink(filename);
+		return -1;
+	}
+
+	// 与Application相同，parse_thread大于1时使用线程池并行解析
+	std::unique_ptr<work::ThreadManager> thread;
+	if (plan.parse_thread > 1) {
+		thread.reset(new work::ThreadManager(plan.parse_thread));
+	}
+
+	// 取多次中最快的一次，减少页缓存与调度的影响
+	double			best = 0;
+	std::size_t ids	 = 0;
+	for (int i = 0; i < rounds; ++i) {
+		auto begin		 = std::chrono::steady_clock::now();
+		auto data			 = work::FileManager::LoadFile(plan, type, filename, '\t', thread.get());
+		auto seconds	 = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		best					 = i == 0 ? seconds : std::min(best, seconds);
+		ids						 = 0;
+		for (const auto& type_data: data) {
+			ids += type_data.data.size();
+		}
+	}
+	unlink(filename);
+
+	std::cout << argv[2] << ": " << lines << " lines, " << ids << " ids, parse_thread " << plan.parse_thread
+						<< ", best of " << rounds << " " << best << " s, " << static_cast<uint64_t>(lines / best) << " lines/s" << std::endl;
+	if (thread) {
+		thread->Shutdown();
+	}
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "error_logger.hpp"
+
+namespace {
+	/**
+	 * @brief 二进制日志中定义的一个调用位置
+	 */
+	struct LogSite {
+		int32_t			line;
+		std::string file;
+		std::string function;
+		std::string format;
+	};
+
+	template<typename T>
+	bool DoRead(std::istream& in, T& value) {
+		return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+	}
+
+	bool DoRead(std::istream& in, std::string& value) {
+		uint32_t length;
+		if (!DoRead(in, length)) {
+			return false;
+		}
+		value.resize(length);
+		return length == 0 || static_cast<bool>(in.read(&value[0], length));
+	}
+
+	/**
+	 * @brief 把二进制日志转换为与文本日志相同的格式
+	 * @param in 二进制日志
+	 * @param out 输出的文本
+	 * @return 是否转换了整个文件，文件损坏时返回false
+	 */
+	bool DoDecode(std::istream& in, std::ostream& out) {
+		const auto															magic_length = std::strlen(log_binary_magic);
+		std::unordered_map<uint32_t, LogSite> sites;
+		std::string														magic(magic_length, '\0');
+		std::string														what;
+		std::string														line;
+
+		char kind;
+		while (in.get(kind)) {
+			if (kind == log_binary_magic[0]) {
+				// 每次启动的日志从头开始编号
+				magic[0] = kind;
+				if (!in.read(&magic[1], static_cast<std::streamsize>(magic_length - 1)) || magic != log_binary_magic) {
+					std::cerr << "Invalid file header" << std::endl;
+					return false;
+				}
+				sites.clear();
+			} else if (kind == static_cast<char>(LOG_RECORD::SITE)) {
+				uint32_t id;
+				LogSite	 site;
+				if (!DoRead(in, id) || !DoRead(in, site.line) || !DoRead(in, site.file) || !DoRead(in, site.function) || !DoRead(in, site.format)) {
+					std::cerr << "Truncated site definition" << std::endl;
+					return false;
+				}
+				sites[id] = std::move(site);
+			} else if (kind == static_cast<char>(LOG_RECORD::ENTRY)) {
+				uint32_t id;
+				uint8_t	 level;
+				if (!DoRead(in, id) || !DoRead(in, level) || !DoRead(in, what)) {
+					std::cerr << "Truncated log entry" << std::endl;
+					return false;
+				}
+				auto it = sites.find(id);
+				if (it == sites.end()) {
+					std::cerr << "Undefined site " << id << std::endl;
+					return false;
+				}
+				const auto& site = it->second;
+				LogLocation where{site.file.c_str(), site.line, site.function.c_str(), site.format.empty() ? nullptr : site.format.c_str()};
+				line.clear();
+				FormatLogLine(line, static_cast<LOG_LEVEL>(level), where, what);
+				out << line;
+			} else {
+				std::cerr << "Unknown record " << static_cast<int>(kind) << " at offset " << (static_cast<std::streamoff>(in.tellg()) - 1) << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+}// namespace
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cerr << "Log file path not given, usage: ./" << argv[0] << " logger_output.bin [output_path]" << std::endl;
+		return -1;
+	}
+
+	std::ifstream in(argv[1], std::ios::in | std::ios::binary);
+	if (!in) {
+		std::cerr << "Cannot open file: " << argv[1] << std::endl;
+		return -1;
+	}
+
+	if (argc < 3) {
+		return DoDecode(in, std::cout) ? 0 : -1;
+	}
+	std::ofstream out(argv[2], std::ios::out | std::ios::trunc);
+	if (!out) {
+		std::cerr << "Cannot open file: " << argv[2] << std::endl;
+		return -1;
+	}
+	return DoDecode(in, out) ? 0 : -1;
+}
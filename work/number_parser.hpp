@@ -0,0 +1,87 @@
+#ifndef NUMBER_PARSER_HPP
+#define NUMBER_PARSER_HPP
+
+#include <cstdint>
+#include <cstring>
+
+#include "string_span.hpp"
+
+namespace work {
+	namespace detail {
+		/**
+		 * @brief 判断8个字节是否全部是数字(SWAR)
+		 * @param chunk 8个字节
+		 * @return 是否全部是数字
+		 */
+		inline bool IsEightDigits(uint64_t chunk) {
+			// 高4位必须是3('0'-'9'为0x30-0x39)，并且加上6之后不能进位到高4位
+			return ((chunk & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL) &&
+						 (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL);
+		}
+
+		/**
+		 * @brief 将8个数字字符转换为数值(SWAR)，要求小端序并且已经通过IsEightDigits检查
+		 * @param chunk 8个字节，第一个字符在最低位
+		 * @return 数值
+		 */
+		inline uint64_t ParseEightDigits(uint64_t chunk) {
+			chunk -= 0x3030303030303030ULL;
+			// 相邻的两位合并为 0-99
+			chunk = (chunk * 10) + (chunk >> 8);
+			// 相邻的两个 0-99 合并为 0-9999，再将两个 0-9999 合并
+			chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+							 (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >>
+							32;
+			return chunk;
+		}
+	}// namespace detail
+
+	/**
+	 * @brief 将字符串解析为无符号整数，不分配内存也不抛出异常
+	 * 与stoull不同，字符串必须全部由数字组成(不接受空白，正负号以及尾部的其他字符)
+	 * @param str 要解析的字符串
+	 * @param out 解析的结果，解析失败时不修改
+	 * @return 是否解析成功(空串，非数字，溢出均失败)
+	 */
+	inline bool ParseUnsigned(StringSpan str, uint64_t& out) {
+		if (str.empty()) {
+			return false;
+		}
+
+		const char*				 p				 = str.data();
+		StringSpan::size_type remain = str.size();
+		uint64_t							 value	 = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		while (remain >= 8) {
+			uint64_t chunk;
+			std::memcpy(&chunk, p, sizeof(chunk));
+			if (!detail::IsEightDigits(chunk)) {
+				return false;
+			}
+			if (__builtin_mul_overflow(value, 100000000ULL, &value) ||
+					__builtin_add_overflow(value, detail::ParseEightDigits(chunk), &value)) {
+				return false;
+			}
+			p += 8;
+			remain -= 8;
+		}
+#endif
+
+		for (; remain != 0; ++p, --remain) {
+			auto digit = static_cast<unsigned char>(*p - '0');
+			if (digit > 9) {
+				return false;
+			}
+			if (__builtin_mul_overflow(value, 10ULL, &value) ||
+					__builtin_add_overflow(value, static_cast<uint64_t>(digit), &value)) {
+				return false;
+			}
+		}
+
+		out = value;
+		return true;
+	}
+}// namespace work
+
+#endif//NUMBER_PARSER_HPP
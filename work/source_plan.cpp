@@ -0,0 +1,63 @@
+#include "source_plan.hpp"
+
+#include <algorithm>
+
+#include "error_logger.hpp"
+
+namespace work {
+	namespace data {
+		SourcePlan SourcePlan::Compile(const DataSourceFieldDetail& detail) {
+			SourcePlan plan;
+
+			plan.code.reserve(detail.code.size());
+			for (const auto& name_code: detail.code) {
+				plan.code.push_back({name_code.first, name_code.second.column, CodeFilter{name_code.second}});
+				plan.max_column = std::max(plan.max_column, name_code.second.column);
+			}
+			// 最便宜并且最有选择性的code最先判断
+			std::stable_sort(plan.code.begin(), plan.code.end(), [](const CodeSlot& lhs, const CodeSlot& rhs) {
+				return lhs.filter.GetRejectRate() / lhs.filter.GetCost() > rhs.filter.GetRejectRate() / rhs.filter.GetCost();
+			});
+
+			auto price = detail.code.find("price");
+			if (price != detail.code.end()) {
+				plan.price_column = price->second.column;
+			}
+
+			plan.layer_column = detail.layer;
+			plan.max_column		= std::max(plan.max_column, detail.layer);
+
+			plan.field.reserve(detail.field.size());
+			plan.field_name.reserve(detail.field.size());
+			for (const auto& kv: detail.field) {
+				bool pad = std::find(detail.pad_field_name.cbegin(), detail.pad_field_name.cend(), kv.first) != detail.pad_field_name.cend();
+				plan.field.push_back({kv.second, pad});
+				plan.field_name.push_back(kv.first);
+				plan.max_column = std::max(plan.max_column, kv.second);
+			}
+
+			if (!detail.pad_data.empty() && !detail.pad_field_name.empty()) {
+				try {
+					plan.pad_json = std::make_shared<const nlohmann::json>(nlohmann::json::parse(detail.pad_data));
+				} catch (const nlohmann::json::exception& e) {
+					LOG2FILE(LOG_LEVEL::ERROR, "Invalid pad_data, will not pad: " + detail.pad_data + " (" + e.what() + ")");
+				}
+			}
+
+			plan.parse_thread = detail.parse_thread;
+
+			return plan;
+		}
+
+		FileDataType SourcePlan::MakeEmptyData() const {
+			FileDataType ret{};
+
+			ret.reserve(field_name.size());
+			for (const auto& name: field_name) {
+				// 只设置类型
+				ret.push_back({name, {}});
+			}
+			return ret;
+		}
+	}// namespace data
+}// namespace work
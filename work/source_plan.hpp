@@ -0,0 +1,97 @@
+#ifndef SOURCE_PLAN_HPP
+#define SOURCE_PLAN_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "code_filter.hpp"
+#include "data_form.hpp"
+
+namespace work {
+	namespace data {
+		/**
+		 * @brief 由DataSourceFieldDetail在载入配置时编译得到的解析计划
+		 * 解析时只依赖配置的工作(列的查找，字段的定位，填充数据的解析等)都在这里预先完成，解析每一行时不再访问原始配置
+		 */
+		struct SourcePlan {
+			using size_type								 = DataSourceFieldDetail::size_type;
+
+			constexpr static size_type npos = static_cast<size_type>(-1);
+
+			struct CodeSlot {
+				/**
+				 * @brief code的名字，只用于日志
+				 */
+				std::string					 name;
+				/**
+				 * @brief code所在的列
+				 */
+				size_type						 column;
+				/**
+				 * @brief 由code的详情编译得到的过滤器
+				 */
+				CodeFilter					 filter;
+			};
+
+			struct FieldSlot {
+				/**
+				 * @brief 字段所在的列
+				 */
+				size_type column;
+				/**
+				 * @brief 字段是否需要填充数据
+				 */
+				bool			pad;
+			};
+
+			/**
+			 * @brief 所有需要校验的code，按照(估计的)拒绝概率与开销之比从大到小排列，使被拒绝的行尽早结束判断
+			 */
+			std::vector<CodeSlot>								code;
+			/**
+			 * @brief price所在的列，没有price时为npos
+			 */
+			size_type														price_column = npos;
+			/**
+			 * @brief layer所在的列
+			 */
+			size_type														layer_column = 0;
+			/**
+			 * @brief 所有字段，下标与解析结果(FileDataType)中的下标一一对应
+			 */
+			std::vector<FieldSlot>							field;
+			/**
+			 * @brief 所有字段的名字，下标与field一一对应
+			 */
+			std::vector<std::string>						field_name;
+			/**
+			 * @brief 只解析一次的填充数据，所有需要填充的数据共享，为空表示不填充
+			 */
+			std::shared_ptr<const nlohmann::json> pad_json;
+			/**
+			 * @brief 解析一行最多需要的列(包含)，之后的列不需要切分
+			 */
+			size_type														max_column	 = 0;
+			/**
+			 * @brief 解析单个文件时使用的线程数
+			 */
+			size_type														parse_thread = 1;
+
+			/**
+			 * @brief 编译解析计划
+			 * @param detail 文件内容解释详情
+			 * @return 解析计划
+			 */
+			static SourcePlan										Compile(const DataSourceFieldDetail& detail);
+
+			/**
+			 * @brief 创建一个只设置了类型的空结果，类型的顺序与field一致
+			 * @return 空结果
+			 */
+			FileDataType												MakeEmptyData() const;
+		};
+	}// namespace data
+}// namespace work
+
+#endif//SOURCE_PLAN_HPP
@@ -0,0 +1,74 @@
+#ifndef STRING_SPAN_HPP
+#define STRING_SPAN_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace work {
+	/**
+	 * @brief 一段不持有内存的字符串视图(c++11下没有std::string_view)
+	 * 注意，视图的生命周期不能超过其所引用的内存
+	 */
+	class StringSpan {
+	public:
+		using size_type			 = std::size_t;
+		using const_iterator = const char*;
+
+		constexpr static size_type npos = static_cast<size_type>(-1);
+
+		constexpr StringSpan() noexcept
+			: data_(nullptr),
+				size_(0) {}
+
+		constexpr StringSpan(const char* data, size_type size) noexcept
+			: data_(data),
+				size_(size) {}
+
+		StringSpan(const std::string& str) noexcept//NOLINT 需要 implicit conversions
+			: data_(str.data()),
+				size_(str.size()) {}
+
+		constexpr const char* data() const noexcept { return data_; }
+		constexpr size_type		size() const noexcept { return size_; }
+		constexpr bool				empty() const noexcept { return size_ == 0; }
+
+		const_iterator				begin() const noexcept { return data_; }
+		const_iterator				end() const noexcept { return data_ + size_; }
+
+		constexpr char				operator[](size_type index) const noexcept { return data_[index]; }
+
+		/**
+		 * @brief 获取子视图
+		 * @param pos 起始位置
+		 * @param count 长度，超出部分会被截断
+		 * @return 子视图
+		 */
+		StringSpan						SubSpan(size_type pos, size_type count = npos) const noexcept {
+			if (pos > size_) {
+				return {};
+			}
+			return {data_ + pos, count > size_ - pos ? size_ - pos : count};
+		}
+
+		/**
+		 * @brief 转换为std::string(会进行拷贝)
+		 * @return 拷贝的字符串
+		 */
+		std::string						ToString() const { return {data_, size_}; }
+
+		friend bool operator==(StringSpan lhs, StringSpan rhs) noexcept {
+			return lhs.size_ == rhs.size_ && (lhs.size_ == 0 || std::memcmp(lhs.data_, rhs.data_, lhs.size_) == 0);
+		}
+
+		friend bool operator!=(StringSpan lhs, StringSpan rhs) noexcept {
+			return !(lhs == rhs);
+		}
+
+	private:
+		const char* data_;
+		size_type		size_;
+	};
+}// namespace work
+
+#endif//STRING_SPAN_HPP
@@ -1,7 +1,91 @@
 #include "thread_manager.hpp"
 
+#include <algorithm>
+
+#include "error_logger.hpp"
+
 namespace work {
+	ThreadManager::ThreadManager(size_type thread_count)
+		: thread_count_(thread_count == 0 ? std::max(boost::thread::hardware_concurrency(), 1u) : thread_count) {
+		for (size_type i = 0; i < thread_count_; ++i) {
+			thread_group_.create_thread([this]() { DoWork(); });
+		}
+	}
+
 	ThreadManager::~ThreadManager() {
-		thread_group_.join_all();
+		Shutdown();
+	}
+
+	uint64_t ThreadManager::DoNewGroup() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return next_group_++;
+	}
+
+	bool ThreadManager::DoRunPendingTask(uint64_t group) {
+		std::function<void()> task;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto												it = std::find_if(tasks_.begin(), tasks_.end(), [group](const Task& task) {
+				 return task.group == group;
+			 });
+			if (it == tasks_.end()) {
+				return false;
+			}
+			task = std::move(it->function);
+			tasks_.erase(it);
+		}
+		task();
+		return true;
+	}
+
+	void ThreadManager::Shutdown() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		not_empty_.notify_all();
+		// 在线程池的线程中调用时不能等待自己
+		if (!thread_group_.is_this_thread_in()) {
+			thread_group_.join_all();
+		}
+	}
+
+	ThreadManager::size_type ThreadManager::GetThreadCount() const {
+		return thread_count_;
+	}
+
+	ThreadManager::size_type ThreadManager::GetPendingCount() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return tasks_.size();
+	}
+
+	bool ThreadManager::DoPush(uint64_t group, std::function<void()> task) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (stopping_) {
+				LOG2FILE(LOG_LEVEL::WARNING, "Thread pool is shutting down, run task in current thread");
+				return false;
+			}
+			tasks_.push_back({group, std::move(task)});
+		}
+		not_empty_.notify_one();
+		return true;
+	}
+
+	void ThreadManager::DoWork() {
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				not_empty_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+				// 关闭之后依然执行完队列中的任务
+				if (tasks_.empty()) {
+					return;
+				}
+				task = std::move(tasks_.front().function);
+				tasks_.pop_front();
+			}
+			task();
+		}
 	}
 }// namespace work
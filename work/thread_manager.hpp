@@ -2,12 +2,98 @@
 #define THREAD_MANAGER_HPP
 
 #include <boost/thread/thread.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 
 namespace work {
+	/**
+	 * @brief 固定线程数的线程池，所有线程在构造时创建，任务放入队列由空闲的线程取出执行
+	 * 长时间运行的函数(例如流水线的每个阶段)会一直占用一个线程，线程数需要包括它们
+	 */
 	class ThreadManager {
 	public:
+		using size_type = std::size_t;
+
+		/**
+		 * @brief 创建线程池
+		 * @param thread_count 线程数，为0时使用硬件线程数
+		 */
+		explicit ThreadManager(size_type thread_count = 0);
+
+		ThreadManager(const ThreadManager&) = delete;
+		ThreadManager& operator=(const ThreadManager&) = delete;
+
+		/**
+		 * @brief 等待队列中所有的任务执行完之后结束所有线程
+		 */
+		~ThreadManager();
+
+		/**
+		 * @brief 一组fork-join的任务，等待时在当前线程中帮助执行这一组中还没有开始的任务，
+		 * 所以在线程池的线程中等待自己提交的任务也不会因为没有空闲的线程而死锁，
+		 * 并且不会执行长时间运行的函数(例如流水线的每个阶段)或者其他调用者提交的任务
+		 */
+		class TaskGroup {
+		public:
+			explicit TaskGroup(ThreadManager& thread)
+				: thread_(thread),
+					group_(thread.DoNewGroup()) {}
+
+			/**
+			 * @brief 提交一个属于这一组的任务
+			 * @tparam Func 函数类型
+			 * @tparam Args 参数类型
+			 * @param func 函数
+			 * @param args 所有参数
+			 * @return 任务的结果，任务抛出的异常在get时重新抛出
+			 */
+			template<typename Func, typename... Args>
+			auto Submit(Func&& func, Args&&... args) -> std::future<decltype(std::bind(std::forward<Func>(func), std::forward<Args>(args)...)())> {
+				return thread_.DoSubmit(group_, std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+			}
+
+			/**
+			 * @brief 等待这一组中的一个任务的结果，等待期间在当前线程中执行这一组中还没有开始的任务
+			 * @tparam T 结果类型
+			 * @param future 任务的结果
+			 * @return 任务的结果
+			 */
+			template<typename T>
+			T Wait(std::future<T>& future) {
+				while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+					if (!thread_.DoRunPendingTask(group_)) {
+						// 这一组中没有还没开始的任务，需要的任务正在其他线程中执行
+						future.wait();
+					}
+				}
+				return future.get();
+			}
+
+		private:
+			ThreadManager& thread_;
+			uint64_t			 group_;
+		};
+
 		/**
-		 * @brief 创建一个线程执行所给函数
+		 * @brief 提交一个任务，已经关闭时直接在当前线程中执行
+		 * @tparam Func 函数类型
+		 * @tparam Args 参数类型
+		 * @param func 函数
+		 * @param args 所有参数
+		 * @return 任务的结果，任务抛出的异常在get时重新抛出
+		 */
+		template<typename Func, typename... Args>
+		auto Submit(Func&& func, Args&&... args) -> std::future<decltype(std::bind(std::forward<Func>(func), std::forward<Args>(args)...)())> {
+			return DoSubmit(no_group, std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+		}
+
+		/**
+		 * @brief 提交一个不关心结果的任务
 		 * @tparam Func 函数类型
 		 * @tparam Args 参数类型
 		 * @param func 函数
@@ -15,14 +101,103 @@ namespace work {
 		 */
 		template<typename Func, typename... Args>
 		void PushFunction(Func&& func, Args&&... args) {
-			thread_group_.template create_thread(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
-			//		thread_group.template create_thread(boost::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+			Submit(std::forward<Func>(func), std::forward<Args>(args)...);
 		}
 
-		~ThreadManager();
+		/**
+		 * @brief 等待任务的结果，只阻塞等待，不会执行队列中的任务(fork-join的任务使用TaskGroup)
+		 * @tparam T 结果类型
+		 * @param future 任务的结果
+		 * @return 任务的结果
+		 */
+		template<typename T>
+		T Wait(std::future<T>& future) {
+			return future.get();
+		}
+
+		/**
+		 * @brief 不再接受新的任务，等待队列中所有的任务执行完之后结束所有线程，可以重复调用
+		 */
+		void			Shutdown();
+
+		/**
+		 * @brief 获取线程数
+		 * @return 线程数
+		 */
+		size_type GetThreadCount() const;
+
+		/**
+		 * @brief 获取队列中等待执行的任务数
+		 * @return 任务数
+		 */
+		size_type GetPendingCount() const;
 
 	private:
-		boost::thread_group thread_group_;
+		// 不属于任何一组的任务，等待时不会被其他线程帮助执行
+		constexpr static uint64_t no_group = 0;
+
+		/**
+		 * @brief 队列中的一个任务
+		 */
+		struct Task {
+			uint64_t							group;
+			std::function<void()> function;
+		};
+
+		/**
+		 * @brief 提交一个任务，已经关闭时直接在当前线程中执行
+		 * @tparam Bound 绑定了参数的函数类型
+		 * @param group 任务所属的组
+		 * @param bound 绑定了参数的函数
+		 * @return 任务的结果
+		 */
+		template<typename Bound>
+		auto DoSubmit(uint64_t group, Bound&& bound) -> std::future<decltype(bound())> {
+			using result_type = decltype(bound());
+
+			// std::function需要可以复制，所以std::packaged_task放在堆上
+			auto task					= std::make_shared<std::packaged_task<result_type()>>(std::forward<Bound>(bound));
+			auto future				= task->get_future();
+			if (!DoPush(group, [task]() { (*task)(); })) {
+				// 关闭之后提交的任务(例如关闭时还在运行的任务中的fork-join)在当前线程中执行，保证future有效
+				(*task)();
+			}
+			return future;
+		}
+
+		/**
+		 * @brief 分配一个新的组
+		 * @return 组的编号
+		 */
+		uint64_t DoNewGroup();
+
+		/**
+		 * @brief 在当前线程中执行一个队列中属于某一组的任务
+		 * @param group 组
+		 * @return 是否执行了任务，队列中没有这一组的任务时返回false
+		 */
+		bool		 DoRunPendingTask(uint64_t group);
+
+		/**
+		 * @brief 放入一个任务
+		 * @param group 任务所属的组
+		 * @param task 任务
+		 * @return 是否放入，已经关闭时返回false
+		 */
+		bool		 DoPush(uint64_t group, std::function<void()> task);
+
+		/**
+		 * @brief 每个线程执行的循环，直到关闭并且队列为空
+		 */
+		void DoWork();
+
+		size_type													thread_count_;
+		mutable std::mutex								mutex_;
+		std::condition_variable						not_empty_;
+		std::deque<Task>									tasks_;
+		bool															stopping_		= false;
+		uint64_t													next_group_ = no_group + 1;
+		boost::thread_group								thread_group_;
 	};
 }// namespace work
 